@@ -0,0 +1,458 @@
+/*
+Native post-processing of the experiment traces. Plain C++17, no ns-3 needed:
+    g++ -O2 -std=c++17 -pthread Analysis/trace-analyzer.cc -o trace-analyzer
+It also builds as an ns-3 scratch program like the experiments.
+
+The trace is memory-mapped and split into one chunk per thread at line
+boundaries. Every thread parses its chunk into columns (time, flow, value)
+with its own flow dictionary, and the columns are merged at the end. The
+first column is the time, the last the value, and the columns in between
+identify the flow (a flow ID in the DCTCP .dat files, the 4-tuple in the PCN
+throughput.csv). A header line is recognised by a non-numeric first field.
+Tab and comma separators are both accepted.
+
+    trace-analyzer throughput <trace> [-o prefix] [-j threads]
+        <prefix>_series.csv   Flow,Time,Value sorted by flow then time
+        <prefix>_summary.csv  per flow: key columns, samples, first row in the
+                              series, mean, p50, p95, p99 and max throughput
+        <prefix>_fairness.csv Jain's index over the flows with a non-zero
+                              value at each time
+    trace-analyzer queue <trace> [-o prefix] [-j threads]
+        <prefix>_cdf.csv      Value,CDF over all samples
+        <prefix>_summary.csv  samples, mean, p50, p95, p99 and max
+
+Percentiles are nearest-rank. The default prefix is the trace name without
+its extension.
+*/
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+struct Chunk
+{
+    std::vector<double> time;
+    std::vector<uint32_t> flow;
+    std::vector<double> value;
+    std::vector<std::string_view> keys;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    // Sum, sum of squares and count of the non-zero values at each time
+    std::unordered_map<double, std::array<double, 3>> fairness;
+    std::map<double, uint64_t> counts;
+};
+
+static bool ParseDouble(std::string_view field, double& out)
+{
+    while (!field.empty() && (field.front() == ' ' || field.front() == '"'))
+    {
+        field.remove_prefix(1);
+    }
+    while (!field.empty() && (field.back() == ' ' || field.back() == '"' || field.back() == '\r'))
+    {
+        field.remove_suffix(1);
+    }
+    if (field.empty())
+    {
+        return false;
+    }
+    std::from_chars_result r = std::from_chars(field.data(), field.data() + field.size(), out);
+    return r.ec == std::errc() && r.ptr == field.data() + field.size();
+}
+
+// Splits [begin, end) into lines and each line into time, key and value
+static void ParseChunk(const char* begin, const char* end, char delim, bool queue, Chunk& chunk)
+{
+    const char* line = begin;
+    while (line < end)
+    {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!eol)
+        {
+            eol = end;
+        }
+        std::string_view text(line, eol - line);
+        line = eol + 1;
+        if (!text.empty() && text.back() == '\r')
+        {
+            text.remove_suffix(1);
+        }
+        size_t first = text.find(delim);
+        size_t last = text.rfind(delim);
+        if (first == std::string_view::npos)
+        {
+            continue;
+        }
+        double time, value;
+        if (!ParseDouble(text.substr(0, first), time) || !ParseDouble(text.substr(last + 1), value))
+        {
+            continue;
+        }
+        if (queue)
+        {
+            chunk.counts[value]++;
+            continue;
+        }
+        std::string_view key = first == last ? std::string_view() : text.substr(first + 1, last - first - 1);
+        std::pair<std::unordered_map<std::string_view, uint32_t>::iterator, bool> id =
+            chunk.ids.emplace(key, chunk.keys.size());
+        if (id.second)
+        {
+            chunk.keys.push_back(key);
+        }
+        chunk.time.push_back(time);
+        chunk.flow.push_back(id.first->second);
+        chunk.value.push_back(value);
+        if (value > 0)
+        {
+            std::array<double, 3>& f = chunk.fairness[time];
+            f[0] += value;
+            f[1] += value * value;
+            f[2] += 1;
+        }
+    }
+}
+
+// Nearest-rank percentile of sorted values
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t rank = (size_t)std::ceil(p / 100 * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static std::string Trim(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '"'))
+    {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '"' || s.back() == '\r'))
+    {
+        s.remove_suffix(1);
+    }
+    return std::string(s);
+}
+
+// Key columns as CSV fields, whatever the input separator
+static std::string KeyFields(std::string_view key, char delim)
+{
+    std::string out;
+    size_t start = 0;
+    while (true)
+    {
+        size_t next = key.find(delim, start);
+        out += Trim(key.substr(start, next == std::string_view::npos ? std::string_view::npos : next - start));
+        if (next == std::string_view::npos)
+        {
+            return out;
+        }
+        out += ",";
+        start = next + 1;
+    }
+}
+
+static int Usage()
+{
+    std::cerr << "Usage: trace-analyzer throughput|queue <trace> [-o prefix] [-j threads]\n";
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        return Usage();
+    }
+    std::string mode = argv[1];
+    std::string path = argv[2];
+    std::string prefix = path;
+    size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos && (path.find_last_of('/') == std::string::npos || dot > path.find_last_of('/')))
+    {
+        prefix = path.substr(0, dot);
+    }
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (std::strcmp(argv[i], "-o") == 0)
+        {
+            prefix = argv[i + 1];
+        }
+        else if (std::strcmp(argv[i], "-j") == 0)
+        {
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else
+        {
+            return Usage();
+        }
+    }
+    if (mode != "throughput" && mode != "queue")
+    {
+        return Usage();
+    }
+    bool queue = mode == "queue";
+
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        std::perror(path.c_str());
+        return 1;
+    }
+    size_t size = st.st_size;
+    const char* data = "";
+    if (size > 0)
+    {
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            std::perror("mmap");
+            return 1;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(map);
+    }
+    const char* end = data + size;
+
+    // Separator and column names from the first line
+    const char* eol = static_cast<const char*>(memchr(data, '\n', size));
+    std::string_view firstLine(data, (eol ? eol : end) - data);
+    char delim = firstLine.find('\t') != std::string_view::npos ? '\t' : ',';
+    double probe;
+    std::string keyHeader = "Flow";
+    std::string timeHeader = "Time";
+    std::string valueHeader = "Value";
+    size_t first = firstLine.find(delim);
+    size_t last = firstLine.rfind(delim);
+    if (first != std::string_view::npos && !ParseDouble(firstLine.substr(0, first), probe))
+    {
+        timeHeader = Trim(firstLine.substr(0, first));
+        valueHeader = Trim(firstLine.substr(last + 1));
+        if (first != last)
+        {
+            keyHeader = KeyFields(firstLine.substr(first + 1, last - first - 1), delim);
+        }
+    }
+
+    // One chunk per thread, cut at line boundaries
+    threads = std::min<size_t>(threads, std::max<size_t>(1, size / (1 << 20)));
+    std::vector<const char*> cuts(threads + 1, end);
+    cuts[0] = data;
+    for (unsigned t = 1; t < threads; t++)
+    {
+        const char* cut = data + size / threads * t;
+        const char* nl = static_cast<const char*>(memchr(cut, '\n', end - cut));
+        cuts[t] = nl ? nl + 1 : end;
+    }
+    std::vector<Chunk> chunks(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back(ParseChunk, cuts[t], std::max(cuts[t], cuts[t + 1]), delim, queue, std::ref(chunks[t]));
+    }
+    for (std::thread& w : workers)
+    {
+        w.join();
+    }
+
+    if (queue)
+    {
+        std::map<double, uint64_t> counts;
+        for (Chunk& c : chunks)
+        {
+            for (const std::pair<const double, uint64_t>& v : c.counts)
+            {
+                counts[v.first] += v.second;
+            }
+        }
+        uint64_t samples = 0;
+        double sum = 0;
+        for (const std::pair<const double, uint64_t>& v : counts)
+        {
+            samples += v.second;
+            sum += v.first * v.second;
+        }
+        std::ofstream cdf(prefix + "_cdf.csv");
+        cdf << valueHeader << ",CDF\n";
+        double p[3] = {50, 95, 99};
+        double q[3] = {0, 0, 0};
+        uint64_t seen = 0;
+        for (const std::pair<const double, uint64_t>& v : counts)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                if (seen < (uint64_t)std::ceil(p[i] / 100 * samples) && seen + v.second >= (uint64_t)std::ceil(p[i] / 100 * samples))
+                {
+                    q[i] = v.first;
+                }
+            }
+            seen += v.second;
+            cdf << v.first << "," << (double)seen / samples << "\n";
+        }
+        std::ofstream summary(prefix + "_summary.csv");
+        summary << "Samples,Mean,P50,P95,P99,Max\n";
+        summary << samples << "," << (samples ? sum / samples : 0) << "," << q[0] << "," << q[1] << "," << q[2] << ","
+                << (counts.empty() ? 0 : counts.rbegin()->first) << "\n";
+        std::cout << samples << " samples, mean " << (samples ? sum / samples : 0) << ", p99 " << q[2] << "\n";
+        return 0;
+    }
+
+    // Global flow IDs in order of first appearance in the file
+    std::vector<std::string_view> keys;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::vector<uint32_t>> remap(threads);
+    for (unsigned t = 0; t < threads; t++)
+    {
+        for (std::string_view key : chunks[t].keys)
+        {
+            std::pair<std::unordered_map<std::string_view, uint32_t>::iterator, bool> id = ids.emplace(key, keys.size());
+            if (id.second)
+            {
+                keys.push_back(key);
+            }
+            remap[t].push_back(id.first->second);
+        }
+    }
+
+    // Counting sort of the rows by flow; file order is kept within a flow
+    size_t nflows = keys.size();
+    std::vector<size_t> offset(nflows + 1, 0);
+    for (unsigned t = 0; t < threads; t++)
+    {
+        for (uint32_t f : chunks[t].flow)
+        {
+            offset[remap[t][f] + 1]++;
+        }
+    }
+    for (size_t f = 0; f < nflows; f++)
+    {
+        offset[f + 1] += offset[f];
+    }
+    size_t rows = offset[nflows];
+    std::vector<double> time(rows), value(rows);
+    std::vector<size_t> fill(offset.begin(), offset.end() - 1);
+    for (unsigned t = 0; t < threads; t++)
+    {
+        for (size_t i = 0; i < chunks[t].flow.size(); i++)
+        {
+            size_t at = fill[remap[t][chunks[t].flow[i]]]++;
+            time[at] = chunks[t].time[i];
+            value[at] = chunks[t].value[i];
+        }
+    }
+
+    // Per-flow statistics in parallel, flows split round robin over the threads
+    struct Stats
+    {
+        double mean, p50, p95, p99, max;
+    };
+    std::vector<Stats> stats(nflows);
+    workers.clear();
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            std::vector<double> sorted;
+            for (size_t f = t; f < nflows; f += threads)
+            {
+                size_t b = offset[f], e = offset[f + 1];
+                // Rows of one flow from different chunks are already in file order; sort only if time is not
+                if (!std::is_sorted(time.begin() + b, time.begin() + e))
+                {
+                    std::vector<std::pair<double, double>> pairs(e - b);
+                    for (size_t i = b; i < e; i++)
+                    {
+                        pairs[i - b] = std::make_pair(time[i], value[i]);
+                    }
+                    std::stable_sort(pairs.begin(), pairs.end(),
+                                     [](const std::pair<double, double>& a, const std::pair<double, double>& b) {
+                                         return a.first < b.first;
+                                     });
+                    for (size_t i = b; i < e; i++)
+                    {
+                        time[i] = pairs[i - b].first;
+                        value[i] = pairs[i - b].second;
+                    }
+                }
+                sorted.assign(value.begin() + b, value.begin() + e);
+                std::sort(sorted.begin(), sorted.end());
+                double sum = 0;
+                for (double v : sorted)
+                {
+                    sum += v;
+                }
+                stats[f] = Stats{sorted.empty() ? 0 : sum / sorted.size(), Percentile(sorted, 50), Percentile(sorted, 95),
+                                 Percentile(sorted, 99), sorted.empty() ? 0 : sorted.back()};
+            }
+        });
+    }
+    for (std::thread& w : workers)
+    {
+        w.join();
+    }
+
+    std::ofstream series(prefix + "_series.csv");
+    series << "Flow," << timeHeader << "," << valueHeader << "\n";
+    char buf[64];
+    for (size_t f = 0; f < nflows; f++)
+    {
+        for (size_t i = offset[f]; i < offset[f + 1]; i++)
+        {
+            int n = std::snprintf(buf, sizeof(buf), "%zu,%.9g,%.9g\n", f, time[i], value[i]);
+            series.write(buf, n);
+        }
+    }
+
+    std::ofstream summary(prefix + "_summary.csv");
+    summary << "Flow," << keyHeader << ",Samples,FirstRow,Mean,P50,P95,P99,Max\n";
+    double sumMeans = 0, sumSquares = 0;
+    for (size_t f = 0; f < nflows; f++)
+    {
+        summary << f << "," << KeyFields(keys[f], delim) << "," << offset[f + 1] - offset[f] << "," << offset[f] << ","
+                << stats[f].mean << "," << stats[f].p50 << "," << stats[f].p95 << "," << stats[f].p99 << ","
+                << stats[f].max << "\n";
+        sumMeans += stats[f].mean;
+        sumSquares += stats[f].mean * stats[f].mean;
+    }
+
+    std::map<double, std::array<double, 3>> fairness;
+    for (Chunk& c : chunks)
+    {
+        for (const std::pair<const double, std::array<double, 3>>& f : c.fairness)
+        {
+            std::array<double, 3>& acc = fairness[f.first];
+            acc[0] += f.second[0];
+            acc[1] += f.second[1];
+            acc[2] += f.second[2];
+        }
+    }
+    std::ofstream jain(prefix + "_fairness.csv");
+    jain << timeHeader << ",Flows,Jain\n";
+    for (const std::pair<const double, std::array<double, 3>>& f : fairness)
+    {
+        jain << f.first << "," << f.second[2] << "," << f.second[0] * f.second[0] / (f.second[2] * f.second[1]) << "\n";
+    }
+
+    std::cout << rows << " rows, " << nflows << " flows, Jain's index over the flow means "
+              << (sumSquares > 0 ? sumMeans * sumMeans / (nflows * sumSquares) : 0) << "\n";
+    return 0;
+}
@@ -3,57 +3,51 @@ This is the second CUBIC experiment. Here, we will measure the throughput
 of two TCP flows using same TCP variants (CUBIC, NewReno, BIC, HighSpeed) 
 over a bottleneck link with varying RTTs (16ms, 32ms, 64ms, 128ms, 256ms, 512ms). 
 We will measure the throughput of the two flows and the throughput ratio of the 
-two flows. We will run the experiment for 100 seconds and measure the throughput 
-at the end of the simulation.
+two flows. Each point runs until the steady-state throughput ratio is known to
+within 5% (95% confidence), or for at most 100 seconds.
 */
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
 #include "ns3/internet-module.h"
 #include "ns3/point-to-point-module.h"
 #include "ns3/applications-module.h"
-#include "ns3/flow-monitor-module.h"
 #include "ns3/stats-module.h"
+#include "../common/fast-setup.h"
+#include "../common/progress-reporter.h"
+#include "../common/steady-state.h"
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("CubicExperiment");
 
-void MeasureThroughput (Ptr<FlowMonitor> flowMonitor, Ptr<Ipv4FlowClassifier> classifier, double &throughput1, double &throughput2) {
-    throughput1 = 0.0;
-    throughput2 = 0.0;
-    std::map<FlowId, FlowMonitor::FlowStats> stats = flowMonitor->GetFlowStats();
-    for (std::map<FlowId, FlowMonitor::FlowStats>::const_iterator i = stats.begin (); i != stats.end (); ++i) {
-        Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow (i->first);
-        std::cout<<"Flow ID: "<<i->first<<" Source IP: "<<t.sourceAddress<<" Source Port: "<<t.sourcePort<<" Destination IP: "<<t.destinationAddress<<" Destination Port: "<<t.destinationPort<<"\n";
-        if (i->first == 1) { // flow 1
-            throughput1 = i->second.rxBytes * 8.0 / (i->second.timeLastRxPacket.GetSeconds () - i->second.timeFirstTxPacket.GetSeconds ()) / 1024 / 1024;
-        } else if (i->first == 2) { // flow 2
-            throughput2 = i->second.rxBytes * 8.0 / (i->second.timeLastRxPacket.GetSeconds () - i->second.timeFirstTxPacket.GetSeconds ()) / 1024 / 1024;
-        }
-    }
-}
+std::string progressFile;
+std::ofstream setupProfile;
 
-void RunExperiment (std::string tcpVariant, uint32_t rtt, double &throughput1, double &throughput2) {
+SteadyStateController::Result RunExperiment (std::string tcpVariant, uint32_t rtt) {
+    SetupProfiler profiler;
     Config::SetDefault ("ns3::TcpL4Protocol::SocketType", StringValue (tcpVariant));
 
+    profiler.Begin ("nodes");
     NodeContainer routers, sender, receiver;
     sender.Create (2);
     routers.Create (2);
     receiver.Create (2);
 
+    profiler.Begin ("stack");
     InternetStackHelper internet;
     internet.Install (routers);
     internet.Install (sender);
     internet.Install (receiver);
     uint32_t rtt_ = (rtt - 10)/4;
 
+    profiler.Begin ("links");
     PointToPointHelper p2p, bottleneck;
-    p2p.SetDeviceAttribute ("DataRate", StringValue ("1Gbps"));
-    p2p.SetChannelAttribute ("Delay", StringValue (std::to_string(rtt_) + "ms"));
+    p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate ("1Gbps")));
+    p2p.SetChannelAttribute ("Delay", TimeValue (MilliSeconds (rtt_)));
 
     uint32_t bdp = 400 /8 * 1024 * 1024 /1000 * 5;
-    bottleneck.SetDeviceAttribute ("DataRate", StringValue ("400Mbps"));
-    bottleneck.SetChannelAttribute ("Delay", StringValue ("5ms"));
+    bottleneck.SetDeviceAttribute ("DataRate", DataRateValue (DataRate ("400Mbps")));
+    bottleneck.SetChannelAttribute ("Delay", TimeValue (MilliSeconds (5)));
     bottleneck.SetQueue ("ns3::DropTailQueue", "MaxSize", QueueSizeValue (QueueSize (QueueSizeUnit::BYTES, bdp)));
 
     NetDeviceContainer senderDevices1 = p2p.Install (sender.Get (0), routers.Get (0));
@@ -64,83 +58,88 @@ void RunExperiment (std::string tcpVariant, uint32_t rtt, double &throughput1, d
 
     NetDeviceContainer routerDevices = bottleneck.Install (routers.Get (0), routers.Get (1));
 
-    Ipv4AddressHelper address;
-    address.SetBase ("10.1.1.0", "255.255.255.0");
+    // 10.1.1.0/24 to 10.1.5.0/24, in this order
+    profiler.Begin ("addresses");
+    FastAddressAssigner address (Ipv4Address ("10.1.1.0"), 24);
     Ipv4InterfaceContainer senderInterfaces1 = address.Assign (senderDevices1);
-
-    address.SetBase ("10.1.2.0", "255.255.255.0");
     Ipv4InterfaceContainer senderInterfaces2 = address.Assign (senderDevices2);
-
-    address.SetBase ("10.1.3.0", "255.255.255.0");
     Ipv4InterfaceContainer receiverInterfaces1 = address.Assign (receiverDevices1);
-
-    address.SetBase ("10.1.4.0", "255.255.255.0");
     Ipv4InterfaceContainer receiverInterfaces2 = address.Assign (receiverDevices2);
-
-    address.SetBase ("10.1.5.0", "255.255.255.0");
     Ipv4InterfaceContainer routerInterfaces = address.Assign (routerDevices);
 
+    profiler.Begin ("routing");
     Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
 
+    profiler.Begin ("applications");
     uint16_t port = 9;
     double START_TIME = 1.0;
     double STOP_TIME = 100.0;
 
-    OnOffHelper onOffHelper1 ("ns3::TcpSocketFactory", InetSocketAddress (receiverInterfaces1.GetAddress (0), port));
-    onOffHelper1.SetAttribute ("DataRate", DataRateValue (DataRate ("1Gbps")));
-    onOffHelper1.SetAttribute ("PacketSize", UintegerValue (1024));
-    onOffHelper1.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
-    onOffHelper1.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
-    ApplicationContainer onOffApp1 = onOffHelper1.Install (sender.Get (0));
-    onOffApp1.Start (Seconds (START_TIME));
-    onOffApp1.Stop (Seconds (STOP_TIME));
-
-    PacketSinkHelper sinkHelper1 ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
-    ApplicationContainer sinkApp1 = sinkHelper1.Install (receiver.Get (0));
-    sinkApp1.Start (Seconds (START_TIME));
-    sinkApp1.Stop (Seconds (STOP_TIME));
-
-    OnOffHelper onOffHelper2 ("ns3::TcpSocketFactory", InetSocketAddress (receiverInterfaces2.GetAddress (0), port));
-    onOffHelper2.SetAttribute ("DataRate", DataRateValue (DataRate ("1Gbps")));
-    onOffHelper2.SetAttribute ("PacketSize", UintegerValue (1024));
-    onOffHelper2.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
-    onOffHelper2.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
-    ApplicationContainer onOffApp2 = onOffHelper2.Install (sender.Get (1));
-    onOffApp2.Start (Seconds (START_TIME));
-    onOffApp2.Stop (Seconds (STOP_TIME));
-
-    PacketSinkHelper sinkHelper2 ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
-    ApplicationContainer sinkApp2 = sinkHelper2.Install (receiver.Get (1));
-    sinkApp2.Start (Seconds (START_TIME));
-    sinkApp2.Stop (Seconds (STOP_TIME));
-
-    FlowMonitorHelper flowmon;
-    Ptr<FlowMonitor> monitor = flowmon.InstallAll ();
-    Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier> (flowmon.GetClassifier ());
+    OnOffHelper onOffHelper = ConstantOnOffHelper ("ns3::TcpSocketFactory", DataRate ("1Gbps"), 1024);
+    PacketSinkHelper sinkHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
+    Ipv4InterfaceContainer receiverInterfaces[2] = {receiverInterfaces1, receiverInterfaces2};
+    ApplicationContainer sinkApps[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        onOffHelper.SetAttribute ("Remote", AddressValue (InetSocketAddress (receiverInterfaces[i].GetAddress (0), port)));
+        ApplicationContainer onOffApp = onOffHelper.Install (sender.Get (i));
+        onOffApp.Start (Seconds (START_TIME));
+        onOffApp.Stop (Seconds (STOP_TIME));
+
+        sinkApps[i] = sinkHelper.Install (receiver.Get (i));
+        sinkApps[i].Start (Seconds (START_TIME));
+        sinkApps[i].Stop (Seconds (STOP_TIME));
+    }
+
+    SteadyStateController controller;
+    controller.AddSink (0, DynamicCast<PacketSink> (sinkApps[0].Get (0)));
+    controller.AddSink (1, DynamicCast<PacketSink> (sinkApps[1].Get (0)));
+    // Batches span at least 20 RTTs
+    controller.SetRtt (MilliSeconds (rtt));
+    controller.Start (Seconds (START_TIME));
+
+    ProgressReporter progress (Seconds (STOP_TIME));
+    progress.EnableStatusFile (progressFile);
+    progress.SetStopEstimate ([&controller] () { return controller.GetEstimatedStop (); });
+    progress.Start ();
 
     Simulator::Stop (Seconds (STOP_TIME));
     std::cout<<"Starting simulation\n";
+    profiler.MarkRun ();
     Simulator::Run ();
-    std::cout<<"Simulation completed\n";
-    MeasureThroughput (monitor, classifier, throughput1, throughput2);
+    std::cout<<"Simulation completed at "<<Simulator::Now ().GetSeconds ()<<"s\n";
+    SteadyStateController::Result result = controller.GetResult ();
+    if (setupProfile.is_open ()) {
+        profiler.Write (setupProfile, tcpVariant + "," + std::to_string (rtt));
+    }
 
     Simulator::Destroy ();
+    return result;
 }
 
 int main (int argc, char *argv[]) {
+    CommandLine cmd (__FILE__);
+    std::string setupProfileFile;
+    cmd.AddValue ("progressFile", "Memory-mapped file that holds the live progress line", progressFile);
+    cmd.AddValue ("setupProfile", "CSV file for the wall time of each setup phase per point", setupProfileFile);
+    cmd.Parse (argc, argv);
+
+    if (!setupProfileFile.empty ()) {
+        setupProfile.open (setupProfileFile);
+        SetupProfiler::WriteHeader (setupProfile, "TCP_Variant,RTT");
+    }
+
     std::vector<uint32_t> rtts = {16, 32, 64, 128, 256, 512};
     std::vector<std::string> tcpVariants = {"ns3::TcpCubic", "ns3::TcpNewReno", "ns3::TcpBic", "ns3::TcpHighSpeed"};
 
     std::ofstream outFile;
     outFile.open ("tcp_fairness.csv");
-    outFile << "TCP_Variant,RTT,Throughput1,Throughput2,Throughput_Ratio\n";
+    outFile << "TCP_Variant,RTT,Throughput1,Throughput2,Throughput_Ratio,Ratio_CI95,Warmup,SimTime,Converged\n";
 
     for (std::string tcpVariant : tcpVariants) {
         for (uint32_t rtt : rtts) {
-            double throughput1, throughput2;
-            RunExperiment (tcpVariant, rtt, throughput1, throughput2);
-            double throughputRatio = throughput1 / throughput2;
-            outFile << tcpVariant << "," << rtt << "," << throughput1 << "," << throughput2 << "," << throughputRatio << "\n";
+            SteadyStateController::Result r = RunExperiment (tcpVariant, rtt);
+            outFile << tcpVariant << "," << rtt << "," << r.throughput[0] << "," << r.throughput[1] << "," << r.ratio << ","
+                    << r.ratioHalfWidth << "," << r.warmup << "," << r.stopTime << "," << r.converged << "\n";
         }
     }
 
@@ -5,14 +5,34 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/flow-monitor-module.h"
 #include "ns3/tcp-socket-base.h"
+#include "../common/loss-models.h"
+#include "../common/progress-reporter.h"
+#include "../common/segment-offload.h"
+#include "../common/tcp-state-tracer.h"
+#include <cmath>
 #include <fstream>
 
 using namespace ns3;
 
 uint32_t PacketSize = 1024;
-
-std::ofstream cwnd1;
-std::ofstream cwnd2;
+bool useSegmentOffload = false;
+std::string progressFile;
+// Receive-path loss: "rate" (shared RateErrorModel), "schedule" (geometric drop schedule),
+// "replay" (drop indices from <lossSchedule>1.txt and <lossSchedule>2.txt), "gilbert" or "none"
+std::string lossModel = "rate";
+// Per byte. The rate model draws it per byte of every packet; schedule and replay turn it into the
+// loss probability of one data packet of the actual wire size, so every model and MSS keeps the same level
+double lossRate = 1e-6;
+std::string lossSchedule = "drops";
+bool lossRecord = false;
+double gePGoodBad = 0.0001;
+double gePBadGood = 0.5;
+double geLossBad = 1.0;
+
+std::ofstream drops1;
+std::ofstream drops2;
+
+double traceInterval = 0;
 
 NS_LOG_COMPONENT_DEFINE("FifthScriptExample");
 
@@ -125,25 +145,33 @@ TutorialApp::ScheduleTx()
     }
 }
 
-static void
-CwndChange(uint32_t oldCwnd, uint32_t newCwnd)
-{
-    cwnd1<<Simulator::Now().GetSeconds() << "\t" << newCwnd/PacketSize<<std::endl;
-}
-
-static void
-CwndChange1(uint32_t oldCwnd, uint32_t newCwnd)
-{
-    cwnd2<< Simulator::Now().GetSeconds() << "\t" << newCwnd/PacketSize<<std::endl;
-}
-
 int
 main(int argc, char* argv[])
 {
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("segmentOffload", "Send 64KB super-segments, split at the bottleneck", useSegmentOffload);
+    cmd.AddValue("lossModel", "rate, schedule, replay, gilbert or none", lossModel);
+    cmd.AddValue("lossRate", "Independent loss probability per byte for rate and schedule", lossRate);
+    cmd.AddValue("lossSchedule", "Prefix of the per-receiver drop index files", lossSchedule);
+    cmd.AddValue("lossRecord", "Write the dropped packet indices to <lossSchedule>1.txt and 2.txt", lossRecord);
+    cmd.AddValue("gePGoodBad", "Gilbert-Elliott Good to Bad transition probability", gePGoodBad);
+    cmd.AddValue("gePBadGood", "Gilbert-Elliott Bad to Good transition probability", gePBadGood);
+    cmd.AddValue("geLossBad", "Gilbert-Elliott loss probability in the Bad state", geLossBad);
+    cmd.AddValue("traceInterval", "Minimum ms between two TCP state samples of a field, 0 records every change", traceInterval);
+    cmd.AddValue("progressFile", "Memory-mapped file that holds the live progress line", progressFile);
+    cmd.Parse(argc, argv);
+
     LogComponentEnable("FifthScriptExample", LOG_LEVEL_INFO);
 
+    // Wire segment size is the ns-3 default of 536 bytes
+    SegmentOffloadHelper offload(536);
+
     Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpCubic"));
     Config::SetDefault("ns3::TcpSocket::InitialCwnd", UintegerValue(1));
+    if (useSegmentOffload)
+    {
+        offload.ConfigureTcpDefaults(1);
+    }
     Config::SetDefault("ns3::TcpL4Protocol::RecoveryType",
                        TypeIdValue(TypeId::LookupByName("ns3::TcpClassicRecovery")));
 
@@ -166,10 +194,68 @@ main(int argc, char* argv[])
     NetDeviceContainer receiver2 = pointToPoint.Install(receivers.Get(1), routers.Get(1));
     NetDeviceContainer router = bottleneck.Install(routers.Get(0), routers.Get(1));
 
-    Ptr<RateErrorModel> em = CreateObject<RateErrorModel>();
-    em->SetAttribute("ErrorRate", DoubleValue(0.000001));
-    receiver1.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em));
-    receiver2.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em));
+    if (useSegmentOffload)
+    {
+        offload.EnableOnHostDevice(sender1.Get(0));
+        offload.EnableOnHostDevice(sender2.Get(0));
+        offload.SetCongestionPoint(router);
+    }
+
+    if (lossRecord && lossModel != "replay")
+    {
+        drops1.open(lossSchedule + "1.txt");
+        drops2.open(lossSchedule + "2.txt");
+    }
+    // Data packets at the receivers: the wire MSS plus TCP (with timestamps), IPv4 and PPP headers,
+    // or MTU-sized fragments of the super-segments with offload
+    uint32_t wirePacketBytes = useSegmentOffload ? router.Get(0)->GetMtu() + 2 : 536 + 32 + 20 + 2;
+    double packetLossRate = 1 - std::pow(1 - lossRate, wirePacketBytes);
+    if (lossModel == "rate")
+    {
+        Ptr<RateErrorModel> em = CreateObject<RateErrorModel>();
+        em->SetAttribute("ErrorUnit", EnumValue(RateErrorModel::ERROR_UNIT_BYTE));
+        em->SetAttribute("ErrorRate", DoubleValue(lossRate));
+        receiver1.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em));
+        receiver2.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em));
+    }
+    else if (lossModel == "schedule" || lossModel == "replay")
+    {
+        // One model per receiver, so each drop sequence only depends on its own flow
+        Ptr<DropScheduleErrorModel> em1 = CreateObject<DropScheduleErrorModel>();
+        Ptr<DropScheduleErrorModel> em2 = CreateObject<DropScheduleErrorModel>();
+        em1->SetAttribute("ErrorRate", DoubleValue(packetLossRate));
+        em2->SetAttribute("ErrorRate", DoubleValue(packetLossRate));
+        if (lossModel == "replay")
+        {
+            em1->LoadSchedule(lossSchedule + "1.txt");
+            em2->LoadSchedule(lossSchedule + "2.txt");
+        }
+        else if (lossRecord)
+        {
+            em1->SetRecord(&drops1);
+            em2->SetRecord(&drops2);
+        }
+        receiver1.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em1));
+        receiver2.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em2));
+    }
+    else if (lossModel == "gilbert")
+    {
+        Ptr<GilbertElliottErrorModel> em1 = CreateObjectWithAttributes<GilbertElliottErrorModel>(
+            "PGoodBad", DoubleValue(gePGoodBad), "PBadGood", DoubleValue(gePBadGood), "LossBad", DoubleValue(geLossBad));
+        Ptr<GilbertElliottErrorModel> em2 = CreateObjectWithAttributes<GilbertElliottErrorModel>(
+            "PGoodBad", DoubleValue(gePGoodBad), "PBadGood", DoubleValue(gePBadGood), "LossBad", DoubleValue(geLossBad));
+        if (lossRecord)
+        {
+            em1->SetRecord(&drops1);
+            em2->SetRecord(&drops2);
+        }
+        receiver1.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em1));
+        receiver2.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em2));
+    }
+    else if (lossModel != "none")
+    {
+        NS_FATAL_ERROR("Unknown loss model " << lossModel);
+    }
 
     InternetStackHelper stack;
     stack.InstallAll();
@@ -197,7 +283,9 @@ main(int argc, char* argv[])
     sinkApps.Stop(Seconds(20.));
 
     Ptr<Socket> ns3TcpSocket = Socket::CreateSocket(senders.Get(0), TcpSocketFactory::GetTypeId());
-    ns3TcpSocket->TraceConnectWithoutContext("CongestionWindow", MakeCallback(&CwndChange));
+    TcpStateTracer tcpState;
+    tcpState.SetMinInterval(MilliSeconds(traceInterval));
+    tcpState.Attach(ns3TcpSocket, "flow1");
 
     Ptr<TutorialApp> app = CreateObject<TutorialApp>();
     app->Setup(ns3TcpSocket, sinkAddress, PacketSize, DataRate("1Gbps"));
@@ -213,7 +301,7 @@ main(int argc, char* argv[])
     sinkApps1.Stop(Seconds(20.));
 
     Ptr<Socket> ns3TcpSocket1 = Socket::CreateSocket(senders.Get(1), TcpSocketFactory::GetTypeId());
-    ns3TcpSocket1->TraceConnectWithoutContext("CongestionWindow", MakeCallback(&CwndChange1));
+    tcpState.Attach(ns3TcpSocket1, "flow2");
 
     Ptr<TutorialApp> app1 = CreateObject<TutorialApp>();
     app1->Setup(ns3TcpSocket1, sinkAddress1, PacketSize, DataRate("1Gbps"));
@@ -221,13 +309,14 @@ main(int argc, char* argv[])
     app1->SetStartTime(Seconds(1.));
     app1->SetStopTime(Seconds(20.));
 
-    cwnd1.open("cwnd1.txt");
-    cwnd2.open("cwnd2.txt");
-
     // Flow Monitor
     FlowMonitorHelper flowmon;
     Ptr<FlowMonitor> monitor = flowmon.InstallAll();
 
+    ProgressReporter progress(Seconds(20));
+    progress.EnableStatusFile(progressFile);
+    progress.Start();
+
     Simulator::Stop(Seconds(20));
     Simulator::Run();
 
@@ -247,8 +336,12 @@ main(int argc, char* argv[])
         std::cout << "Throughput: " << flow.second.rxBytes * 8.0 / 20.0 / 1000000000.0 << " Gbps" << std::endl;
     }
 
+    std::ofstream tcpStateFile("tcpState.csv");
+    tcpState.Dump(tcpStateFile);
+    tcpStateFile.close();
+
     Simulator::Destroy();
-    cwnd1.close();
-    cwnd2.close();
+    drops1.close();
+    drops2.close();
     return 0;
 }
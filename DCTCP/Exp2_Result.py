@@ -1,24 +1,21 @@
 # This file is used to plot the result of experiment 2
 # The result is the throughput of multiple DCTCP flows after 0.1 seconds
+# Run the trace analyzer first (see the README):
+#   trace-analyzer throughput throughput.dat
+#   trace-analyzer queue queue_sizes.dat
 
 import matplotlib.pyplot as plt
 import numpy as np
 
-data = np.genfromtxt("throughput.dat", skip_header=1, delimiter='\t', dtype=float)
-
-flow = {}
-for i in range(len(data)):
-    if data[i][1] not in flow:
-        flow[data[i][1]] = [[data[i][0], data[i][2]]]
-    else:
-        flow[data[i][1]].append([data[i][0], data[i][2]])
+# Rows of the series are sorted by flow, the summary gives the first row of each flow
+series = np.loadtxt("throughput_series.csv", skiprows=1, delimiter=',', ndmin=2)
+summary = np.genfromtxt("throughput_summary.csv", names=True, delimiter=',', ndmin=1)
+flows = np.split(series, summary['FirstRow'][1:].astype(int))
 
 # Plot the result
 plt.figure()
-for key in flow:
-    x = [i[0] for i in flow[key]]
-    y = [i[1] for i in flow[key]]
-    plt.plot(x, y, label='Flow ' + str(int(key)))
+for row, flow in zip(summary, flows):
+    plt.plot(flow[:, 1], flow[:, 2], label='Flow ' + str(int(row['Flow_ID'])))
 plt.xlabel('Time (s)')
 plt.ylabel('Throughput (Mbps)')
 plt.legend()
@@ -26,18 +23,21 @@ plt.title('Throughput of Multiple DCTCP Flows')
 plt.savefig('Exp2_Throughput.png')
 
 # Further is the queue size of one switch in the network
-data = np.genfromtxt("queue_sizes.dat", skip_header=1, delimiter='\t', dtype=float)
-queue = []
-for i in range(len(data)):
-    queue.append([data[i][0], data[i][1]])
+data = np.genfromtxt("queue_sizes.dat", skip_header=1, delimiter='\t', dtype=float, ndmin=2)
 
 # Plot the result
 plt.figure()
-x = [i[0] for i in queue]
-y = [i[1] for i in queue]
-plt.plot(x, y)
+plt.plot(data[:, 0], data[:, 1])
 plt.xlabel('Time (s)')
 plt.ylabel('Queue Size (packets)')
 plt.title('Queue Size of One Switch in the Network')
 plt.savefig('Exp2_Queue.png')
-    
+
+# Distribution of the queue size
+cdf = np.loadtxt("queue_sizes_cdf.csv", skiprows=1, delimiter=',', ndmin=2)
+plt.figure()
+plt.step(cdf[:, 0], cdf[:, 1], where='post')
+plt.xlabel('Queue Size (packets)')
+plt.ylabel('CDF')
+plt.title('Queue Size Distribution of One Switch in the Network')
+plt.savefig('Exp2_Queue_CDF.png')
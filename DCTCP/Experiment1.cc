@@ -2,8 +2,12 @@
 This is the first experiment of the DCTCP lab. In this experiment, 
 we will simulate a simple network topology with 2 senders, 1 switch, 
 and 1 receiver. The senders will send data to the receiver using DCTCP. 
-We will use a RED queue disc for the switch. We will also monitor the 
-queue size of the switch.
+We will use a step-marking (single threshold K) ECN queue disc for the 
+switch. We will also monitor the queue size of the switch.
+K defaults to 50 packets, where the RED queue disc used before (MinTh 50, 
+MaxTh 80, QW 1) started marking. RED marked only a fraction of the packets 
+between 50 and 80, the step marks all of them, so the queue settles a little 
+lower than with RED.
 */
 
 #include "ns3/core-module.h"
@@ -13,10 +17,15 @@ queue size of the switch.
 #include "ns3/applications-module.h"
 #include "ns3/traffic-control-module.h"
 #include "ns3/flow-monitor-module.h"
+#include "../common/progress-reporter.h"
+#include "../common/step-marking-queue-disc.h"
 
 using namespace ns3;
 
 std::ofstream queueSizes;
+std::string progressFile;
+// DCTCP marking threshold, in packets (e.g. 20p) or bytes (e.g. 30000B)
+std::string markingThreshold = "50p";
 
 void CheckQueueSize(Ptr<QueueDisc> qdisc){
     uint32_t qSize = qdisc->GetNPackets();
@@ -24,7 +33,12 @@ void CheckQueueSize(Ptr<QueueDisc> qdisc){
     Simulator::Schedule(MilliSeconds(125), &CheckQueueSize, qdisc);
 }
 
-int main(){
+int main(int argc, char* argv[]){
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("progressFile", "Memory-mapped file that holds the live progress line", progressFile);
+    cmd.AddValue("K", "DCTCP marking threshold in packets or bytes", markingThreshold);
+    cmd.Parse(argc, argv);
+
     Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpDctcp"));
     NodeContainer nodes;
     // 2 Sender, 1 Switch, 1 Receiver
@@ -34,14 +48,6 @@ int main(){
     Config::SetDefault("ns3::TcpSocket::DelAckCount", UintegerValue(2));
     GlobalValue::Bind("ChecksumEnabled", BooleanValue(true));
 
-    Config::SetDefault("ns3::RedQueueDisc::UseEcn", BooleanValue(true));
-    Config::SetDefault("ns3::RedQueueDisc::UseHardDrop", BooleanValue(false));
-    Config::SetDefault ("ns3::RedQueueDisc::MeanPktSize", UintegerValue (1500));
-    Config::SetDefault("ns3::RedQueueDisc::MaxSize", QueueSizeValue(QueueSize("2666p")));
-    Config::SetDefault ("ns3::RedQueueDisc::QW", DoubleValue (1));
-    Config::SetDefault ("ns3::RedQueueDisc::MinTh", DoubleValue (10));
-    Config::SetDefault ("ns3::RedQueueDisc::MaxTh", DoubleValue (20));
-
     PointToPointHelper p2p;
     p2p.SetDeviceAttribute("DataRate", StringValue("1Gbps"));
     p2p.SetChannelAttribute("Delay", StringValue("10us"));
@@ -55,11 +61,9 @@ int main(){
     stack.Install(nodes);
 
     TrafficControlHelper tch;
-    tch.SetRootQueueDisc("ns3::RedQueueDisc",
-                         "LinkBandwidth", StringValue("1Gbps"),
-                         "LinkDelay", StringValue("10us"),
-                         "MinTh", DoubleValue(50),
-                         "MaxTh", DoubleValue(80));
+    tch.SetRootQueueDisc("ns3::StepMarkingQueueDisc",
+                         "MaxSize", QueueSizeValue(QueueSize("2666p")),
+                         "K", QueueSizeValue(QueueSize(markingThreshold)));
 
     QueueDiscContainer qdiscs = tch.Install(t2r);
     QueueDiscContainer qdiscs2 = tch.Install(s1t1);
@@ -114,6 +118,10 @@ int main(){
 
     Simulator::Schedule(MilliSeconds(125), &CheckQueueSize, qdiscs.Get(0));
 
+    ProgressReporter progress(Seconds(5.0));
+    progress.EnableStatusFile(progressFile);
+    progress.Start();
+
     Simulator::Stop(Seconds(5.0));
     Simulator::Run();
 
@@ -1,7 +1,7 @@
 /*
 This is the second DCTCP experiment. In this experiment, we will simulate a simple network topology
 of 6 devices connected to each other via a switch. We will use DCTCP to send data between the devices.
-5 devices will send data to the 6th device. We will use a RED queue disc for the switch. The objective
+5 devices will send data to the 6th device. We will use a step-marking ECN queue disc for the switch. The objective
 of this experiment is to observer the convergence of DCTCP. Hence, each sender will start sending data 
 at different times (10 seconds apart) and end at different times (10 seconds apart). We will monitor the
 throughput of each sender and the queue size of the switch.
@@ -14,6 +14,12 @@ throughput of each sender and the queue size of the switch.
 #include "ns3/applications-module.h"
 #include "ns3/traffic-control-module.h"
 #include "ns3/flow-monitor-module.h"
+#include "../common/int-telemetry.h"
+#include "../common/pcap-ring-capture.h"
+#include "../common/progress-reporter.h"
+#include "../common/rollup-writer.h"
+#include "../common/step-marking-queue-disc.h"
+#include "../common/tcp-state-tracer.h"
 
 using namespace ns3;
 
@@ -25,12 +31,31 @@ using namespace ns3;
 std::ofstream queueSizes;
 std::ofstream throughput;
 std::map<FlowId, uint32_t> TotalRxBytes;
+std::string progressFile;
+// DCTCP marking threshold, in packets (e.g. 20p) or bytes (e.g. 30000B)
+std::string markingThreshold = "20p";
+// Minimum ms between two samples of the same TCP state field of a sender
+double traceInterval = 1;
+// Incident capture on the receiver port: ms of packets kept before a trigger, 0 disables it
+double captureWindow = 0;
+uint32_t captureMarks = 100;
+// ms between two queue and throughput samples; with rollups the samples only feed the
+// 1ms/10ms/100ms/1s rollups and the decimated series instead of the .dat files
+double sampleInterval = RESULT_TIME * 1000;
+bool useRollups = false;
+RollupWriter queueRollups;
+RollupWriter throughputRollups;
+// In-band telemetry of 1 in intSample packets, stamped by the switch ports, 0 disables it
+uint32_t intSample = 0;
 
 void CheckQueueSize(Ptr<QueueDisc> qdisc){
-    std::cout<<"Progress "<<Simulator::Now().GetSeconds() <<" Seconds"<<std::endl;
     uint32_t qSize = qdisc->GetNPackets();
-    queueSizes<<Simulator::Now().GetSeconds()<<"\t"<<qSize<<std::endl;
-    Simulator::Schedule(Seconds(RESULT_TIME), &CheckQueueSize, qdisc);
+    if(useRollups){
+        queueRollups.Add("", qSize);
+    }else{
+        queueSizes<<Simulator::Now().GetSeconds()<<"\t"<<qSize<<std::endl;
+    }
+    Simulator::Schedule(Seconds(sampleInterval / 1000), &CheckQueueSize, qdisc);
 }
 
 void CheckThroughput(Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier){
@@ -44,15 +69,33 @@ void CheckThroughput(Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifie
             }
             uint32_t lastTotalRxBytes = TotalRxBytes[i->first];
             uint32_t currentTotalRxBytes = i->second.rxBytes;
-            double throughput_ = (currentTotalRxBytes - lastTotalRxBytes) * 8.0 / RESULT_TIME / 1024 / 1024;
-            throughput<<Simulator::Now().GetSeconds()<<"\t"<<i->first<<"\t"<<throughput_<<std::endl;    
+            double throughput_ = (currentTotalRxBytes - lastTotalRxBytes) * 8.0 / (sampleInterval / 1000) / 1024 / 1024;
+            if(useRollups){
+                throughputRollups.Add(std::to_string(i->first), throughput_);
+            }else{
+                throughput<<Simulator::Now().GetSeconds()<<"\t"<<i->first<<"\t"<<throughput_<<std::endl;
+            }
             TotalRxBytes[i->first] = currentTotalRxBytes;
         }
     }
-    Simulator::Schedule(Seconds(RESULT_TIME), &CheckThroughput, monitor, classifier);
+    Simulator::Schedule(Seconds(sampleInterval / 1000), &CheckThroughput, monitor, classifier);
 }
 
-int main(){
+int main(int argc, char* argv[]){
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("K", "DCTCP marking threshold in packets or bytes", markingThreshold);
+    cmd.AddValue("traceInterval", "Minimum ms between two TCP state samples of a field, 0 records every change", traceInterval);
+    cmd.AddValue("captureWindow", "ms of packets written to pcap before an incident at the receiver port, 0 disables", captureWindow);
+    cmd.AddValue("captureMarks", "ECN marks within 1ms at the receiver port that trigger a capture", captureMarks);
+    cmd.AddValue("sampleInterval", "ms between two queue and throughput samples", sampleInterval);
+    cmd.AddValue("rollups", "Write min/max/mean/last rollups and an LTTB series instead of the raw samples", useRollups);
+    cmd.AddValue("intSample", "Carry queue, egress time and utilization of the switch ports in 1 in N packets, 0 disables", intSample);
+    cmd.AddValue("progressFile", "Memory-mapped file that holds the live progress line", progressFile);
+    cmd.Parse(argc, argv);
+    if(sampleInterval <= 0){
+        NS_FATAL_ERROR("sampleInterval must be positive, got " << sampleInterval);
+    }
+
     Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpDctcp"));
     NodeContainer nodes;
     // 6 devices connected to each other via a switch
@@ -63,14 +106,6 @@ int main(){
     Config::SetDefault("ns3::TcpSocket::DelAckCount", UintegerValue(2));
     GlobalValue::Bind("ChecksumEnabled", BooleanValue(true));
 
-    Config::SetDefault("ns3::RedQueueDisc::UseEcn", BooleanValue(true));
-    Config::SetDefault("ns3::RedQueueDisc::UseHardDrop", BooleanValue(false));
-    Config::SetDefault("ns3::RedQueueDisc::MeanPktSize", UintegerValue(1500));
-    Config::SetDefault("ns3::RedQueueDisc::MaxSize", QueueSizeValue(QueueSize("2666p")));
-    Config::SetDefault("ns3::RedQueueDisc::QW", DoubleValue(1));
-    Config::SetDefault("ns3::RedQueueDisc::MinTh", DoubleValue(10));
-    Config::SetDefault("ns3::RedQueueDisc::MaxTh", DoubleValue(20));
-
     PointToPointHelper p2p;
     p2p.SetDeviceAttribute("DataRate", StringValue("1Gbps"));
     p2p.SetChannelAttribute("Delay", StringValue("10us"));
@@ -85,13 +120,9 @@ int main(){
     stack.InstallAll();
 
     TrafficControlHelper tch;
-    tch.SetRootQueueDisc("ns3::RedQueueDisc",
-                         "LinkBandwidth", StringValue("1Gbps"),
-                         "LinkDelay", StringValue("10us"),
-                         "LinkBandwidth", StringValue("1Gbps"),
-                         "LinkDelay", StringValue("10us"),
-                         "MinTh", DoubleValue(10),
-                         "MaxTh", DoubleValue(20));
+    tch.SetRootQueueDisc("ns3::StepMarkingQueueDisc",
+                         "MaxSize", QueueSizeValue(QueueSize("2666p")),
+                         "K", QueueSizeValue(QueueSize(markingThreshold)));
 
     std::vector<QueueDiscContainer> qdiscs;
     for(uint32_t i = 0; i < 6; i++){
@@ -115,6 +146,30 @@ int main(){
     std::vector<ApplicationContainer> receiveApp;
 
     uint16_t port = 9;
+    // cwnd, ssthresh, RTT, bytes in flight, alpha and state of each sender
+    TcpStateTracer tcpState;
+    tcpState.SetMinInterval(MilliSeconds(traceInterval));
+    // Mark bursts, drops and sender RTOs at the switch port towards the receiver
+    PcapRingCapture capture("incident", MilliSeconds(captureWindow), 16384);
+    std::ofstream captureLog;
+    if(captureWindow > 0){
+        captureLog.open("captures.csv");
+        PcapRingCapture::WriteLogHeader(captureLog);
+        capture.SetLog(&captureLog);
+        capture.AddDevice(devices[5].Get(1), "receiver");
+        capture.TriggerOnMarks(qdiscs[5].Get(1), captureMarks, MilliSeconds(1));
+        capture.TriggerOnDrop(qdiscs[5].Get(1));
+    }
+    // Queue and utilization of the switch ports, seen by the receiver and echoed to each sender in the ACKs
+    IntHelper telemetry(intSample);
+    std::ofstream intLog;
+    if(intSample > 0){
+        intLog.open("int.csv");
+        IntHelper::WriteLogHeader(intLog);
+        telemetry.SetLog(&intLog);
+        telemetry.InstallSwitch(T);
+        telemetry.InstallHosts(nodes);
+    }
     for(uint32_t i = 0; i < 5; i++){
         OnOffHelper onOffHelper("ns3::TcpSocketFactory", InetSocketAddress(interfaces[5].GetAddress(0), port + i));
         onOffHelper.SetAttribute("DataRate", DataRateValue(DataRate("1Gbps")));
@@ -124,6 +179,10 @@ int main(){
 
         ApplicationContainer sender = onOffHelper.Install(nodes.Get(i));
         sendApp.push_back(sender);
+        tcpState.AttachApplication(DynamicCast<OnOffApplication>(sender.Get(0)), "sender" + std::to_string(i + 1));
+        if(captureWindow > 0){
+            capture.AttachRtoApplication(DynamicCast<OnOffApplication>(sender.Get(0)));
+        }
         sender.Start(Seconds(START_TIME + i * JUMP));
         sender.Stop(Seconds(END_TIME - i * JUMP));
 
@@ -134,21 +193,49 @@ int main(){
         sink.Stop(Seconds(END_TIME - i * JUMP));
     }
 
-    queueSizes.open("queue_sizes.dat");
-    queueSizes << "Time(s)\tQueueSize(packets)"<<std::endl;
+    // With rollups the raw .dat files are not written at all
+    if(useRollups){
+        queueRollups.Open("queue_sizes", "", "QueueSize(packets)");
+        throughputRollups.Open("throughput", "Flow ID", "Throughput(Mbps)");
+    }
+    else{
+        queueSizes.open("queue_sizes.dat");
+        queueSizes << "Time(s)\tQueueSize(packets)"<<std::endl;
 
-    throughput.open("throughput.dat");
-    throughput << "Time(s)\tFlow ID\tThroughput(Mbps)"<<std::endl;
+        throughput.open("throughput.dat");
+        throughput << "Time(s)\tFlow ID\tThroughput(Mbps)"<<std::endl;
+    }
 
     FlowMonitorHelper flowmon;
     Ptr<FlowMonitor> monitor = flowmon.InstallAll();
     Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier>(flowmon.GetClassifier());
 
-    Simulator::Schedule(Seconds(RESULT_TIME), &CheckQueueSize, qdiscs[5].Get(1));
-    Simulator::Schedule(Seconds(RESULT_TIME), &CheckThroughput, monitor, classifier);
+    Simulator::Schedule(Seconds(sampleInterval / 1000), &CheckQueueSize, qdiscs[5].Get(1));
+    Simulator::Schedule(Seconds(sampleInterval / 1000), &CheckThroughput, monitor, classifier);
+
+    ProgressReporter progress(Seconds(END_TIME));
+    progress.EnableStatusFile(progressFile);
+    progress.Start();
 
     Simulator::Stop(Seconds(END_TIME));
     Simulator::Run();
+    if(useRollups){
+        queueRollups.Finish();
+        throughputRollups.Finish();
+        std::cout<<"Rollup rows: "<<queueRollups.GetRows() + throughputRollups.GetRows()<<"\n";
+    }
+
+    std::ofstream tcpStateFile("tcpState.csv");
+    tcpState.Dump(tcpStateFile);
+    tcpStateFile.close();
+    if(captureWindow > 0){
+        std::cout<<"Incident captures: "<<capture.GetCaptures()<<", suppressed triggers: "<<capture.GetSuppressed()<<"\n";
+        captureLog.close();
+    }
+    if(intSample > 0){
+        std::cout<<"Telemetry packets sent: "<<telemetry.GetSent()<<", delivered: "<<telemetry.GetDelivered()<<", echoed: "<<telemetry.GetEchoes()<<"\n";
+        intLog.close();
+    }
 
     Simulator::Destroy();
 
@@ -3,7 +3,11 @@ This is the third experiment of the DCTCP lab. In this experiment multiple devic
 One device acts as client and other n devices as server. The client requests data from the servers and the servers respond with
 data with packet of size 1/n MB. This process is done parallely for all the servers. The client sends a request to all the servers.
 Once the client receives the data from all the servers, it sends another request to all the servers. This process is repeated for 
-1000 times and query response time is calculated. 
+1000 times and query response time is calculated. By default the client waits thinkTime (10s) between queries. With
+--queryMode=closed queries are issued back-to-back with several outstanding (closed loop), with --queryMode=open as a
+Poisson process at a target QPS (open loop); each query keeps its own completion state.
+With --transport=credit the responses use the receiver-driven credit transport instead of DCTCP: the client
+requests each response and grants the servers credit at its downlink rate.
 
 Client and Server Applications needs to be implemented. 
 */
@@ -15,12 +19,24 @@ Client and Server Applications needs to be implemented.
 #include "ns3/applications-module.h"
 #include "ns3/traffic-control-module.h"
 #include "ns3/flow-monitor-module.h"
+#include "../common/credit-transport.h"
+#include "../common/progress-reporter.h"
+#include <deque>
 
 using namespace ns3;
 
 uint32_t n_servers = 3;
 uint32_t reps = 10;
+// Query mode: "think" waits thinkTime between queries, "closed" keeps `concurrency`
+// queries outstanding back-to-back, "open" issues queries as a Poisson process at qps
+std::string queryMode = "think";
+uint32_t concurrency = 1;
+double qps = 100.0;
+double thinkTime = 10.0;
+uint32_t querySize = 10;
+std::string transport = "tcp";
 std::ofstream queryTime;
+std::string progressFile;
 
 class ServerApp : public Application{
     public:
@@ -32,9 +48,14 @@ class ServerApp : public Application{
         virtual void StopApplication(void);
         void HandleRead(Ptr<Socket> socket);
         void HandleAccept(Ptr<Socket> s, const Address& from);
+        void HandleSend(Ptr<Socket> socket, uint32_t available);
+        void SendPending(Ptr<Socket> socket);
         Address m_address;
         Ptr<Socket> m_socket;
         uint32_t m_packetSize;
+        // Per connection: bytes of a partially received query, and response bytes not yet handed to TCP
+        std::map<Ptr<Socket>, uint32_t> m_queryBytes;
+        std::map<Ptr<Socket>, uint64_t> m_pending;
 };
 
 ServerApp::ServerApp() : m_socket(0), m_packetSize(0){
@@ -64,108 +85,239 @@ void ServerApp::StopApplication(void){
 
 void ServerApp::HandleAccept(Ptr<Socket> s, const Address& from){
     s->SetRecvCallback(MakeCallback(&ServerApp::HandleRead, this));
+    s->SetSendCallback(MakeCallback(&ServerApp::HandleSend, this));
 }
 
 void ServerApp::HandleRead(Ptr<Socket> socket){
-    // Accept the packet, if packet size > 0, send new packet back to client with m_packetSize
-    Ptr<Packet> packet = socket->Recv();
-    
-    if(packet->GetSize() > 0){
-        NS_LOG_UNCOND("Server returning Packet");
-        Ptr<Packet> p = Create<Packet>(m_packetSize);
-        socket->Send(p);
+    // Several queries can arrive in one read, answer each complete query with m_packetSize bytes
+    Ptr<Packet> packet;
+    while((packet = socket->Recv())){
+        m_queryBytes[socket] += packet->GetSize();
+    }
+    uint32_t queries = m_queryBytes[socket] / querySize;
+    m_queryBytes[socket] %= querySize;
+    if(queries > 0){
+        m_pending[socket] += (uint64_t)queries * m_packetSize;
+        SendPending(socket);
+    }
+}
+
+void ServerApp::HandleSend(Ptr<Socket> socket, uint32_t available){
+    SendPending(socket);
+}
+
+void ServerApp::SendPending(Ptr<Socket> socket){
+    // Responses larger than the free send buffer are pushed as space frees up
+    uint64_t& pending = m_pending[socket];
+    while(pending > 0){
+        uint32_t size = std::min<uint64_t>(std::min<uint64_t>(pending, m_packetSize), socket->GetTxAvailable());
+        if(size == 0 || socket->Send(Create<Packet>(size)) < 0){
+            break;
+        }
+        pending -= size;
     }
 }
 
 class ClientApp : public Application{
     public:
+        enum QueryMode { THINK_TIME, CLOSED_LOOP, OPEN_LOOP };
         ClientApp();
         virtual ~ClientApp();
         // Setup function takes the vector of server addresses, and n_servers
-        void Setup(std::vector<Address> addresses, uint32_t n_servers, uint32_t reps);
+        void Setup(std::vector<Address> addresses, uint32_t n_servers, uint32_t reps, uint32_t responseSize);
+        void SetQueryMode(QueryMode mode, uint32_t concurrency, double qps, Time thinkTime);
+        // Request the responses over the credit transport instead of the TCP connections
+        void UseCreditTransport(Ptr<CreditTransport> credit, std::vector<Ipv4Address> servers);
         void StartQueries();
     private:
+        struct Query{
+            Time start;
+            uint32_t pendingServers;
+        };
         virtual void StartApplication(void);
         virtual void StopApplication(void);
         void HandleRead(Ptr<Socket> socket);
         void SendQuery();
+        void NextArrival();
+        void ServerResponded(uint32_t id);
+        void CreditMessageReceived(Ipv4Address server, uint32_t requestId, uint32_t size);
         std::vector<Address> m_addresses;
         std::vector<Ptr<Socket>> m_sockets;
+        std::map<Ptr<Socket>, uint32_t> m_serverIndex;
         uint32_t m_n_servers;
         uint32_t m_reps;
-        uint32_t m_received;
-        Time m_queryStart;
-        // Need a lock to protect m_received
-        std::mutex m_mutex;
+        uint32_t m_responseSize;
+        QueryMode m_mode;
+        uint32_t m_concurrency;
+        Time m_thinkTime;
+        Ptr<ExponentialRandomVariable> m_interArrival;
+        // Responses come back in order on each connection: per server, the ids of the
+        // outstanding queries and the bytes still missing for the oldest one
+        std::vector<std::deque<uint32_t>> m_outstanding;
+        std::vector<uint32_t> m_headRemaining;
+        std::map<uint32_t, Query> m_queries;
+        uint32_t m_issued;
+        uint32_t m_completed;
+        Ptr<CreditTransport> m_credit;
+        std::vector<Ipv4Address> m_creditServers;
+        // Credit request id -> query id
+        std::map<uint32_t, uint32_t> m_creditQuery;
 };
 
-ClientApp::ClientApp() : m_n_servers(0), m_reps(0), m_received(0){
+ClientApp::ClientApp() : m_n_servers(0), m_reps(0), m_responseSize(0), m_mode(CLOSED_LOOP), m_concurrency(1), m_issued(0), m_completed(0){
 }
 
 ClientApp::~ClientApp(){
 }
 
-void ClientApp::Setup(std::vector<Address> addresses, uint32_t n_servers, uint32_t reps){
+void ClientApp::Setup(std::vector<Address> addresses, uint32_t n_servers, uint32_t reps, uint32_t responseSize){
     m_addresses = addresses;
     m_n_servers = n_servers;
     m_reps = reps;
+    m_responseSize = responseSize;
+}
+
+void ClientApp::SetQueryMode(QueryMode mode, uint32_t concurrency, double qps, Time thinkTime){
+    m_mode = mode;
+    m_concurrency = std::max(concurrency, 1u);
+    m_thinkTime = thinkTime;
+    m_interArrival = CreateObject<ExponentialRandomVariable>();
+    m_interArrival->SetAttribute("Mean", DoubleValue(1.0 / qps));
+}
+
+void ClientApp::UseCreditTransport(Ptr<CreditTransport> credit, std::vector<Ipv4Address> servers){
+    m_credit = credit;
+    m_creditServers = servers;
+    m_credit->SetMessageCallback(MakeCallback(&ClientApp::CreditMessageReceived, this));
 }
 
 void ClientApp::StartQueries(){
-    SendQuery();
+    if(m_mode == OPEN_LOOP){
+        NextArrival();
+        return;
+    }
+    uint32_t initial = m_mode == CLOSED_LOOP ? m_concurrency : 1;
+    for(uint32_t i=0;i<initial;i++){
+        SendQuery();
+    }
 }
 
 void ClientApp::StartApplication(void){
+    if(m_credit){
+        return;
+    }
+    m_outstanding.resize(m_n_servers);
+    m_headRemaining.assign(m_n_servers, 0);
     for(uint32_t i=0;i<m_n_servers;i++){
         Ptr<Socket> socket = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
         socket->SetRecvCallback(MakeCallback(&ClientApp::HandleRead, this));
         socket->Connect(m_addresses[i]);
         m_sockets.push_back(socket);
+        m_serverIndex[socket] = i;
     }
 }
 
 void ClientApp::StopApplication(void){
-    for(uint32_t i=0;i<m_n_servers;i++){
+    for(uint32_t i=0;i<m_sockets.size();i++){
         if(m_sockets[i]){
             m_sockets[i]->Close();
         }
     }
 }
 
+void ClientApp::NextArrival(){
+    SendQuery();
+    if(m_issued < m_reps){
+        Simulator::Schedule(Seconds(m_interArrival->GetValue()), &ClientApp::NextArrival, this);
+    }
+}
+
 void ClientApp::SendQuery(){
-    if(m_reps-- <= 0){
+    if(m_issued >= m_reps){
+        return;
+    }
+    uint32_t id = m_issued++;
+    m_queries[id] = {Simulator::Now(), m_n_servers};
+    NS_LOG_UNCOND("Sending Query "<<id<<" at time: "<<Simulator::Now().GetSeconds());
+    if(m_credit){
+        for(uint32_t i=0;i<m_n_servers;i++){
+            m_creditQuery[m_credit->Request(m_creditServers[i], m_responseSize)] = id;
+        }
         return;
     }
-    m_queryStart = Simulator::Now();
-    NS_LOG_UNCOND("Sending Query at time: "<<m_queryStart.GetSeconds());
-    m_received = 0;
     for(uint32_t i=0;i<m_n_servers;i++){
-        Ptr<Packet> p = Create<Packet>(10);
-        NS_LOG_UNCOND("Sending Query to server of size: "<<p->GetSize());
-        m_sockets[i]->Send(p);
+        if(m_outstanding[i].empty()){
+            m_headRemaining[i] = m_responseSize;
+        }
+        m_outstanding[i].push_back(id);
+        m_sockets[i]->Send(Create<Packet>(querySize));
     }
 }
 
 void ClientApp::HandleRead(Ptr<Socket> socket){
-    NS_LOG_UNCOND("Client recieved response from server");
-    Ptr<Packet> packet = socket->Recv();
-    if(packet->GetSize() > 0){
-        m_mutex.lock();
-        m_received++;
-        if(m_received == m_n_servers){
-            Time queryEnd = Simulator::Now();
-            // Query time in ms
-            double queryTime_ = (queryEnd - m_queryStart).GetMilliSeconds();
-            std::cout<<"Query Time: "<<queryTime_<<"\n";
-            queryTime<<queryTime_<<"\n";
-            // SendQuery();
-            Simulator::Schedule(Seconds(10), &ClientApp::SendQuery, this);
+    uint32_t server = m_serverIndex[socket];
+    Ptr<Packet> packet;
+    while((packet = socket->Recv())){
+        uint32_t bytes = packet->GetSize();
+        while(bytes > 0 && !m_outstanding[server].empty()){
+            uint32_t used = std::min(bytes, m_headRemaining[server]);
+            m_headRemaining[server] -= used;
+            bytes -= used;
+            if(m_headRemaining[server] == 0){
+                uint32_t id = m_outstanding[server].front();
+                m_outstanding[server].pop_front();
+                m_headRemaining[server] = m_responseSize;
+                ServerResponded(id);
+            }
         }
-        m_mutex.unlock();
     }
 }
 
-int main(){
+void ClientApp::CreditMessageReceived(Ipv4Address server, uint32_t requestId, uint32_t size){
+    std::map<uint32_t, uint32_t>::iterator it = m_creditQuery.find(requestId);
+    if(it == m_creditQuery.end()){
+        return;
+    }
+    uint32_t id = it->second;
+    m_creditQuery.erase(it);
+    ServerResponded(id);
+}
+
+void ClientApp::ServerResponded(uint32_t id){
+    Query& query = m_queries[id];
+    if(--query.pendingServers > 0){
+        return;
+    }
+    // Query time in ms
+    double queryTime_ = (Simulator::Now() - query.start).GetSeconds() * 1000;
+    std::cout<<"Query Time: "<<queryTime_<<"\n";
+    queryTime<<queryTime_<<"\n";
+    m_queries.erase(id);
+
+    if(++m_completed == m_reps){
+        // Nothing left to measure, do not simulate the idle tail
+        Simulator::Stop();
+        return;
+    }
+    if(m_mode == CLOSED_LOOP){
+        SendQuery();
+    }else if(m_mode == THINK_TIME){
+        Simulator::Schedule(m_thinkTime, &ClientApp::SendQuery, this);
+    }
+}
+
+int main(int argc, char* argv[]){
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("servers", "Number of servers answering each query", n_servers);
+    cmd.AddValue("reps", "Number of queries", reps);
+    cmd.AddValue("queryMode", "think, closed or open", queryMode);
+    cmd.AddValue("concurrency", "Outstanding queries in closed mode", concurrency);
+    cmd.AddValue("qps", "Query arrival rate in open mode", qps);
+    cmd.AddValue("thinkTime", "Seconds between queries in think mode", thinkTime);
+    cmd.AddValue("transport", "tcp (DCTCP) or credit (receiver-driven)", transport);
+    cmd.AddValue("progressFile", "Memory-mapped file that holds the live progress line", progressFile);
+    cmd.Parse(argc, argv);
+
     uint32_t packetSize = 1024*1024/n_servers;
     Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpDctcp"));
     Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(1448));
@@ -195,21 +347,42 @@ int main(){
     Ipv4AddressHelper address;
     std::vector<Ipv4InterfaceContainer> serverInterface;
     std::vector<Address> serverAddress;
+    std::vector<Ipv4Address> serverIp;
     address.SetBase("10.1.1.0","255.255.255.0");
     for(int i=0;i<(int)n_servers;i++){
         Ipv4InterfaceContainer interface = address.Assign(server[i]);
         serverInterface.push_back(interface);
         serverAddress.push_back(InetSocketAddress(interface.GetAddress(0), 9));
+        serverIp.push_back(interface.GetAddress(0));
         address.NewNetwork();
     }
     Ipv4InterfaceContainer clientInterface = address.Assign(client);
 
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
 
+    if(transport != "tcp" && transport != "credit"){
+        NS_FATAL_ERROR("Unknown transport " << transport);
+    }
+    bool useCredit = transport == "credit";
+    // One credit endpoint per node; the RTT is 4 hops of 5ms, so a window is 2.5MB at 1Gbps
+    std::vector<Ptr<CreditTransport>> creditApps;
+    if(useCredit){
+        for(int i=0;i<=(int)n_servers;i++){
+            Ptr<CreditTransport> credit = CreateObject<CreditTransport>();
+            credit->Setup(100, DataRate("1Gbps"));
+            credit->SetRttBytes(2500000);
+            credit->SetResendTimeout(MilliSeconds(50));
+            nodes.Get(i)->AddApplication(credit);
+            credit->SetStartTime(Seconds(1.0));
+            credit->SetStopTime(Seconds(1000.0));
+            creditApps.push_back(credit);
+        }
+    }
+
     // Create server applications
     NS_LOG_UNCOND("Creating Server Applications");
     std::vector<Ptr<ServerApp>> serverApps;
-    for(int i=0;i<(int)n_servers;i++){
+    for(int i=0;i<(int)n_servers && !useCredit;i++){
         Ptr<ServerApp> app = CreateObject<ServerApp>();
         app->Setup(serverAddress[i], packetSize);
         nodes.Get(i)->AddApplication(app);
@@ -221,7 +394,19 @@ int main(){
     NS_LOG_UNCOND("Creating Client Application");
     // Create client application
     Ptr<ClientApp> clientApp = CreateObject<ClientApp>();
-    clientApp->Setup(serverAddress, n_servers, reps);
+    clientApp->Setup(serverAddress, n_servers, reps, packetSize);
+    ClientApp::QueryMode mode = ClientApp::THINK_TIME;
+    if(queryMode == "closed"){
+        mode = ClientApp::CLOSED_LOOP;
+    }else if(queryMode == "open"){
+        mode = ClientApp::OPEN_LOOP;
+    }else if(queryMode != "think"){
+        NS_FATAL_ERROR("Unknown query mode " << queryMode);
+    }
+    clientApp->SetQueryMode(mode, concurrency, qps, Seconds(thinkTime));
+    if(useCredit){
+        clientApp->UseCreditTransport(creditApps[n_servers], serverIp);
+    }
     nodes.Get(n_servers)->AddApplication(clientApp);
     clientApp->SetStartTime(Seconds(1.0));
     clientApp->SetStopTime(Seconds(1000.0));
@@ -230,10 +415,23 @@ int main(){
 
     Simulator::Schedule(Seconds(1.1), &ClientApp::StartQueries, clientApp);
 
+    ProgressReporter progress(Seconds(1000.0));
+    progress.EnableStatusFile(progressFile);
+    progress.Start();
+
     Simulator::Stop(Seconds(1000.0));
     Simulator::Run();
     Simulator::Destroy();
 
     queryTime.close();
+    if(useCredit){
+        uint64_t resends = 0;
+        uint64_t abandoned = 0;
+        for(uint32_t i=0;i<creditApps.size();i++){
+            resends += creditApps[i]->GetResends();
+            abandoned += creditApps[i]->GetAbandoned();
+        }
+        std::cout<<"Credit transport resend requests: "<<resends<<", abandoned messages: "<<abandoned<<"\n";
+    }
     return 0;
 }
\ No newline at end of file
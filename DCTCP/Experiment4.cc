@@ -0,0 +1,140 @@
+/*
+This is the fourth experiment of the DCTCP lab. Instead of a single star switch, the hosts are connected by a
+k-ary fat tree (k^3/4 hosts, k = 16 gives 1024 hosts) with step-marking ECN queues on every switch port and
+ECMP routes computed in closed form from the topology. Every host sends to another host chosen by a random
+permutation, so most flows cross the core. Each flow either sends flowSize bytes or runs until the end, and the
+goodput of every flow is written to fatTreeThroughput.csv with the flow completion time when it finished.
+The load balancing across the uplinks is per flow (5-tuple hash) or per packet (spraying).
+*/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/traffic-control-module.h"
+#include "../common/fast-setup.h"
+#include "../common/fat-tree-helper.h"
+#include "../common/progress-reporter.h"
+#include "../common/step-marking-queue-disc.h"
+#include <algorithm>
+
+using namespace ns3;
+
+uint32_t k = 4;
+std::string loadBalancing = "hash";
+std::string markingThreshold = "20p";
+uint32_t flowSize = 0;
+double duration = 1.0;
+std::string progressFile;
+std::string setupProfileFile;
+std::ofstream fatTreeThroughput;
+std::vector<Time> flowEnd;
+
+// The flow is complete once its sink has received flowSize bytes
+void SinkRx(uint32_t flow, Ptr<PacketSink> sink, Ptr<const Packet> packet, const Address& from){
+    if(flowEnd[flow].IsZero() && sink->GetTotalRx() >= flowSize){
+        flowEnd[flow] = Simulator::Now();
+    }
+}
+
+int main(int argc, char* argv[]){
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("k", "Fat-tree arity (even, at most 64)", k);
+    cmd.AddValue("lb", "Uplink load balancing: hash (per flow) or spray (per packet)", loadBalancing);
+    cmd.AddValue("K", "DCTCP marking threshold in packets or bytes", markingThreshold);
+    cmd.AddValue("flowSize", "Bytes per flow, 0 sends until the end", flowSize);
+    cmd.AddValue("duration", "Seconds of traffic", duration);
+    cmd.AddValue("progressFile", "Memory-mapped file that holds the live progress line", progressFile);
+    cmd.AddValue("setupProfile", "CSV file for the wall time of each setup phase", setupProfileFile);
+    cmd.Parse(argc, argv);
+
+    Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpDctcp"));
+    Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(1448));
+    Config::SetDefault("ns3::TcpSocket::DelAckCount", UintegerValue(2));
+    GlobalValue::Bind("ChecksumEnabled", BooleanValue(true));
+
+    SetupProfiler profiler;
+    TrafficControlHelper tch;
+    tch.SetRootQueueDisc("ns3::StepMarkingQueueDisc", "MaxSize", QueueSizeValue(QueueSize("2666p")), "K", QueueSizeValue(QueueSize(markingThreshold)));
+
+    FatTreeHelper fatTree(k);
+    fatTree.SetSwitchQueueDisc(tch);
+    fatTree.SetProfiler(&profiler);
+    if(loadBalancing == "spray"){
+        fatTree.SetLoadBalancing(FatTreeRouting::PACKET_SPRAY);
+    }else if(loadBalancing != "hash"){
+        NS_FATAL_ERROR("Unknown load balancing " << loadBalancing);
+    }
+    fatTree.Build();
+
+    profiler.Begin("applications");
+    // Random permutation without fixed points
+    uint32_t n = fatTree.GetNHosts();
+    std::vector<uint32_t> destination(n);
+    for(uint32_t i=0;i<n;i++){
+        destination[i] = i;
+    }
+    Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable>();
+    for(uint32_t i=n-1;i>0;i--){
+        std::swap(destination[i], destination[random->GetInteger(0, i - 1)]);
+    }
+
+    // One helper of each kind, only the remote address changes per flow
+    uint16_t port = 9;
+    BulkSendHelper bulk("ns3::TcpSocketFactory", Address());
+    bulk.SetAttribute("MaxBytes", UintegerValue(flowSize));
+    PacketSinkHelper sinkHelper("ns3::TcpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), port));
+    std::vector<Ptr<PacketSink>> sinks;
+    for(uint32_t i=0;i<n;i++){
+        bulk.SetAttribute("Remote", AddressValue(InetSocketAddress(fatTree.GetHostAddress(destination[i]), port)));
+        ApplicationContainer sender = bulk.Install(fatTree.GetHost(i));
+        sender.Start(Seconds(0.1));
+        sender.Stop(Seconds(0.1 + duration));
+
+        ApplicationContainer sink = sinkHelper.Install(fatTree.GetHost(destination[i]));
+        sink.Start(Seconds(0.0));
+        sinks.push_back(DynamicCast<PacketSink>(sink.Get(0)));
+    }
+
+    flowEnd.assign(n, Time(0));
+    if(flowSize > 0){
+        for(uint32_t i=0;i<n;i++){
+            sinks[i]->TraceConnectWithoutContext("Rx", MakeBoundCallback(&SinkRx, i, sinks[i]));
+        }
+    }
+
+    ProgressReporter progress(Seconds(0.1 + duration));
+    progress.EnableStatusFile(progressFile);
+    progress.Start();
+
+    Simulator::Stop(Seconds(0.1 + duration));
+    profiler.MarkRun();
+    Simulator::Run();
+    std::cout<<"Fat tree k="<<k<<": "<<n<<" hosts, "<<fatTree.GetSwitches().GetN()<<" switches, "<<profiler.GetTotal()<<" s to the first event\n";
+    if(!setupProfileFile.empty()){
+        std::ofstream setupProfile(setupProfileFile);
+        SetupProfiler::WriteHeader(setupProfile, "");
+        profiler.Write(setupProfile, "");
+    }
+
+    fatTreeThroughput.open("fatTreeThroughput.csv");
+    fatTreeThroughput<<"Source,Destination,Bytes,Throughput(Mbps),FCT(ms)\n";
+    double total = 0;
+    for(uint32_t i=0;i<n;i++){
+        uint64_t bytes = sinks[i]->GetTotalRx();
+        double seconds = flowEnd[i].IsZero() ? duration : (flowEnd[i] - Seconds(0.1)).GetSeconds();
+        double mbps = bytes * 8.0 / seconds / 1e6;
+        total += bytes * 8.0 / duration / 1e6;
+        fatTreeThroughput<<fatTree.GetHostAddress(i)<<","<<fatTree.GetHostAddress(destination[i])<<","<<bytes<<","<<mbps<<",";
+        if(!flowEnd[i].IsZero()){
+            fatTreeThroughput<<(flowEnd[i] - Seconds(0.1)).GetMilliSeconds();
+        }
+        fatTreeThroughput<<"\n";
+    }
+    fatTreeThroughput.close();
+    std::cout<<"Aggregate goodput: "<<total<<" Mbps over "<<n<<" flows\n";
+
+    Simulator::Destroy();
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+Real-time emulation of the PCN DDL switch topology with real Linux hosts.
+
+worker1, worker2 and the PS are Linux network namespaces created by setup-netns.sh. Each one is attached
+through a veth pair, a Linux bridge and a tap device to a ghost node of this program. TapBridge in
+UseBridge mode moves the frames between the tap and the ghost node's CSMA link to the simulated router.
+The routers, the 1Gbps r1r2 bottleneck and its queue are simulated in real time:
+
+    ns-w1 ==tap-w1== r1 ---- r2 ==tap-ps== ns-ps
+    ns-w2 ==tap-w2== r1
+
+The bottleneck queue is drop-tail (CUBIC in the namespaces) or, with --dctcp, a step-marking ECN queue
+(DCTCP with ECN in the namespaces). Run iperf3 or the training processes inside the namespaces, e.g.
+    sudo ip netns exec ns-ps iperf3 -s &
+    sudo ip netns exec ns-w1 iperf3 -c 10.1.3.2 -t 30
+
+Scheduler lag is written to schedulerLag.csv every second. The bottleneck queue length goes to q1Size.csv.
+*/
+
+#include <fstream>
+#include <string>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/csma-module.h"
+#include "ns3/tap-bridge-module.h"
+#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/traffic-control-module.h"
+#include "../common/realtime-lag-monitor.h"
+#include "../common/step-marking-queue-disc.h"
+#include <iostream>
+
+using namespace ns3;
+
+std::ofstream q1Size;
+std::ofstream schedulerLag;
+double duration = 60.0;
+bool useDctcp = false;
+std::string markingThreshold = "20p";
+bool hardLimit = false;
+
+void LogQueue1Size(Ptr<QueueDisc> queueDisc){
+    q1Size << Simulator::Now().GetMilliSeconds() << "," << queueDisc->GetNPackets() << "\n";
+    Simulator::Schedule(MilliSeconds(100), &LogQueue1Size, queueDisc);
+}
+
+// Ghost node for a namespace: a CSMA link to the router, bridged to the existing tap device
+NetDeviceContainer attachNamespace(Ptr<Node> router, std::string tap){
+    CsmaHelper csma;
+    csma.SetChannelAttribute("DataRate", StringValue("1Gbps"));
+    csma.SetChannelAttribute("Delay", StringValue("200us"));
+    Ptr<Node> ghost = CreateObject<Node>();
+    NetDeviceContainer devices = csma.Install(NodeContainer(router, ghost));
+
+    TapBridgeHelper tapBridge;
+    tapBridge.SetAttribute("Mode", StringValue("UseBridge"));
+    tapBridge.SetAttribute("DeviceName", StringValue(tap));
+    tapBridge.Install(ghost, devices.Get(1));
+    return devices;
+}
+
+int main(int argc, char* argv[]){
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("duration", "Seconds to run", duration);
+    cmd.AddValue("dctcp", "Step-marking ECN queue at the bottleneck instead of drop-tail", useDctcp);
+    cmd.AddValue("K", "Marking threshold with --dctcp, in packets or bytes", markingThreshold);
+    cmd.AddValue("hardLimit", "Abort when the scheduler falls more than 100ms behind", hardLimit);
+    cmd.Parse(argc, argv);
+
+    GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::RealtimeSimulatorImpl"));
+    GlobalValue::Bind("ChecksumEnabled", BooleanValue(true));
+    if(hardLimit){
+        Config::SetDefault("ns3::RealtimeSimulatorImpl::SynchronizationMode", StringValue("HardLimit"));
+        Config::SetDefault("ns3::RealtimeSimulatorImpl::HardLimit", TimeValue(MilliSeconds(100)));
+    }
+
+    NodeContainer router;
+    router.Create(2);
+
+    NetDeviceContainer w1r1 = attachNamespace(router.Get(0), "tap-w1");
+    NetDeviceContainer w2r1 = attachNamespace(router.Get(0), "tap-w2");
+    NetDeviceContainer psr2 = attachNamespace(router.Get(1), "tap-ps");
+
+    PointToPointHelper p2p;
+    p2p.SetDeviceAttribute("DataRate", StringValue("1Gbps"));
+    p2p.SetChannelAttribute("Delay", StringValue("200us"));
+    p2p.SetQueue("ns3::DropTailQueue", "MaxSize", StringValue("100p"));
+    NetDeviceContainer r1r2 = p2p.Install(router.Get(0), router.Get(1));
+
+    // Only the routers run an IP stack, the hosts are the namespaces
+    InternetStackHelper stack;
+    stack.Install(router);
+
+    TrafficControlHelper tch;
+    if(useDctcp){
+        tch.SetRootQueueDisc("ns3::StepMarkingQueueDisc", "MaxSize", QueueSizeValue(QueueSize("100p")), "K", QueueSizeValue(QueueSize(markingThreshold)));
+    }
+    else{
+        tch.SetRootQueueDisc("ns3::PfifoFastQueueDisc", "MaxSize", StringValue("100p"));
+    }
+    QueueDiscContainer qd1 = tch.Install(r1r2);
+
+    // Router side of each access subnet is .1, setup-netns.sh gives the namespace .2
+    Ipv4AddressHelper address;
+    address.SetBase("10.1.1.0","255.255.255.0");
+    address.Assign(NetDeviceContainer(w1r1.Get(0)));
+    address.SetBase("10.1.2.0","255.255.255.0");
+    address.Assign(NetDeviceContainer(w2r1.Get(0)));
+    address.SetBase("10.1.3.0","255.255.255.0");
+    address.Assign(NetDeviceContainer(psr2.Get(0)));
+    address.SetBase("10.1.4.0","255.255.255.0");
+    address.Assign(r1r2);
+
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+    q1Size.open("q1Size.csv");
+    q1Size << "Time(ms),QueueSize(Packets)\n";
+    Simulator::Schedule(MilliSeconds(100), &LogQueue1Size, qd1.Get(0));
+
+    schedulerLag.open("schedulerLag.csv");
+    RealtimeLagMonitor::WriteHeader(schedulerLag);
+    RealtimeLagMonitor lag;
+    lag.Start(schedulerLag);
+
+    Simulator::Stop(Seconds(duration));
+    Simulator::Run();
+    lag.PrintSummary(std::cout);
+    Simulator::Destroy();
+
+    q1Size.close();
+    schedulerLag.close();
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Create (or with "down", remove) the namespaces, veth pairs, bridges and tap devices used by
+# DDL-Emulation.cc. Needs root. With "dctcp" the namespaces use DCTCP with ECN, otherwise CUBIC.
+#
+#   ns-<h> [veth-<h>] <--> [veth-<h>-br] br-<h> [tap-<h>] <--> ns-3 ghost node
+#
+# Host h gets 10.1.<n>.2/24 with the simulated router at 10.1.<n>.1 as default gateway.
+
+set -e
+
+HOSTS="w1:1 w2:2 ps:3"
+
+down() {
+    for entry in $HOSTS; do
+        h=${entry%%:*}
+        ip netns del "ns-$h" 2>/dev/null || true
+        ip link del "veth-$h-br" 2>/dev/null || true
+        ip link del "tap-$h" 2>/dev/null || true
+        ip link del "br-$h" 2>/dev/null || true
+    done
+}
+
+up() {
+    cc=cubic
+    ecn=0
+    if [ "$1" = "dctcp" ]; then
+        modprobe tcp_dctcp 2>/dev/null || true
+        cc=dctcp
+        ecn=1
+    fi
+    for entry in $HOSTS; do
+        h=${entry%%:*}
+        n=${entry##*:}
+        ip netns add "ns-$h"
+        ip link add "veth-$h" type veth peer name "veth-$h-br"
+        ip link set "veth-$h" netns "ns-$h"
+
+        ip tuntap add "tap-$h" mode tap
+        ip link set "tap-$h" promisc on up
+        ip link add "br-$h" type bridge
+        ip link set "veth-$h-br" master "br-$h" up
+        ip link set "tap-$h" master "br-$h"
+        ip link set "br-$h" up
+
+        ip netns exec "ns-$h" ip link set lo up
+        ip netns exec "ns-$h" ip addr add "10.1.$n.2/24" dev "veth-$h"
+        ip netns exec "ns-$h" ip link set "veth-$h" up
+        ip netns exec "ns-$h" ip route add default via "10.1.$n.1"
+        # Segmentation offloads would hand 64KB frames to the tap, the simulated links carry 1500 bytes
+        ip netns exec "ns-$h" ethtool -K "veth-$h" tso off gso off gro off 2>/dev/null || true
+        ip netns exec "ns-$h" sysctl -q -w net.ipv4.tcp_congestion_control=$cc
+        ip netns exec "ns-$h" sysctl -q -w net.ipv4.tcp_ecn=$ecn
+    done
+}
+
+case "$1" in
+    down)
+        down
+        ;;
+    *)
+        down
+        up "$1"
+        ;;
+esac
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <fstream>
 #include <string>
 #include "ns3/core-module.h"
@@ -8,16 +9,92 @@
 #include "ns3/ipv4-global-routing-helper.h"
 #include "ns3/flow-monitor-module.h"
 #include "ns3/traffic-control-module.h"
+#include "../common/credit-transport.h"
+#include "../common/flow-accounting.h"
+#include "../common/fq-pacing-queue-disc.h"
+#include "../common/heavy-hitter-probe.h"
+#include "../common/hop-latency.h"
+#include "../common/int-telemetry.h"
+#include "../common/memory-census.h"
+#include "../common/pcap-ring-capture.h"
+#include "../common/pfc.h"
+#include "../common/progress-reporter.h"
+#include "../common/rollup-writer.h"
+#include "../common/segment-offload.h"
+#include "../common/trace-replay.h"
 #include <iostream>
+#include <sstream>
 
 using namespace ns3;
 
+// Options of one scenario, from the command line or from a section of the --scenarios file
+struct Scenario{
+    bool useSegmentOffload = false;
+    bool usePfc = false;
+    uint32_t pfcXoff = 60000;
+    uint32_t pfcXon = 30000;
+    bool useFq = false;
+    std::string fqMaxRate = "0bps";
+    // Worker traffic: "onoff" 900Mbps on/off sources, synchronous iterations of gradientSize
+    // bytes per worker over TCP ("tcp") or the receiver-driven credit transport ("credit"),
+    // or the flows of a recorded log ("trace")
+    std::string transport = "onoff";
+    std::string traceFile;
+    uint32_t gradientSize = 112500000;
+    double computeTime = 1.0;
+    std::string progressFile;
+    // Incident capture on r1r2 and psr2: ms of packets kept before a trigger, 0 disables it
+    double captureWindow = 0;
+    uint32_t captureQueue = 90;
+    // Per-flow statistics: "flowmon" keeps every flow to the end, "streaming" evicts finished and idle flows
+    std::string flowAccounting = "flowmon";
+    // ms between two queue and throughput samples; with rollups the samples only feed the
+    // 1ms/10ms/100ms/1s rollups and the decimated series instead of q1Size, q2Size and throughput.csv
+    double sampleInterval = 100;
+    bool useRollups = false;
+    // Per-hop latency breakdown of 1 in latencySample packets, 0 disables it
+    uint32_t latencySample = 0;
+    // Seconds between two memory census samples, 0 disables it
+    double censusInterval = 0;
+    // In-band telemetry of 1 in intSample packets, stamped by both routers, 0 disables it
+    uint32_t intSample = 0;
+    // TCP of every host and queue disc of r1r2 and psr2: "pfifo" drop-tail or "red" with ECN marking
+    std::string tcp = "ns3::TcpCubic";
+    std::string queueDisc = "pfifo";
+    double duration = 50.0;
+    // Appended to every output file name
+    std::string suffix;
+};
+
+Scenario opt;
+std::string scenarioFile;
 std::ofstream q1Size;
 std::ofstream q2Size;
 std::ofstream throughput;
+std::ofstream heavyHitters;
+std::ofstream pauseLog;
 std::map<FlowId, uint32_t> TotalRxBytes;
 std::vector<ApplicationContainer> onOffApps;
 std::vector<ApplicationContainer> sinkApps;
+std::ofstream traceFlows;
+std::ofstream traceJobs;
+std::ofstream iterationTime;
+NodeContainer iterationWorkers;
+Ipv4Address psAddress;
+std::vector<Ptr<CreditTransport>> workerCredit;
+std::map<Ipv4Address, uint64_t> psRxBytes;
+uint32_t iteration = 0;
+uint32_t workersDone = 0;
+Time iterationStart;
+std::ofstream captureLog;
+std::ofstream flowRecords;
+RollupWriter queueRollups;
+RollupWriter throughputRollups;
+std::ofstream hopLatency;
+std::ofstream hopSamples;
+std::ofstream censusLog;
+std::ofstream censusPeakLog;
+std::ofstream intLog;
 
 void createBackgroundApps(InetSocketAddress sinkAddress, Ptr<Node> source, Ptr<Node> dest, uint32_t dataRate, uint32_t packetSize, double startTime, double stopTime, int onTime, int offTime){
     OnOffHelper onOffHelper("ns3::TcpSocketFactory", sinkAddress);
@@ -69,16 +146,64 @@ void createApps(InetSocketAddress sinkAddress, Ptr<Node> source, Ptr<Node> dest,
     sinkApps.push_back(sinkApp);
 }
 
+// Every worker pushes its gradients to the PS; the iteration ends when the PS holds all of them
+void StartIteration(){
+    iterationStart = Simulator::Now();
+    workersDone = 0;
+    for(uint32_t i=0;i<iterationWorkers.GetN();i++){
+        if(opt.transport == "credit"){
+            workerCredit[i]->SendMessage(psAddress, opt.gradientSize);
+            continue;
+        }
+        BulkSendHelper bulk("ns3::TcpSocketFactory", InetSocketAddress(psAddress, 20));
+        bulk.SetAttribute("MaxBytes", UintegerValue(opt.gradientSize));
+        bulk.Install(iterationWorkers.Get(i));
+    }
+}
+
+void WorkerDone(){
+    if(++workersDone < iterationWorkers.GetN()){
+        return;
+    }
+    iterationTime << iteration << "," << iterationStart.GetMilliSeconds() << "," << (Simulator::Now() - iterationStart).GetMilliSeconds() << "\n";
+    iteration++;
+    Simulator::Schedule(Seconds(opt.computeTime), &StartIteration);
+}
+
+void PsReceived(Ptr<const Packet> packet, const Address& from){
+    uint64_t& bytes = psRxBytes[InetSocketAddress::ConvertFrom(from).GetIpv4()];
+    uint64_t target = (uint64_t)(iteration + 1) * opt.gradientSize;
+    bool done = bytes < target && bytes + packet->GetSize() >= target;
+    bytes += packet->GetSize();
+    if(done){
+        WorkerDone();
+    }
+}
+
+void PsMessageReceived(Ipv4Address worker, uint32_t id, uint32_t size){
+    WorkerDone();
+}
+
 void LogQueue1Size(Ptr<QueueDisc> queueDisc){
     uint32_t qsize = queueDisc->GetNPackets();
-    q1Size << Simulator::Now().GetMilliSeconds() << "," << qsize << "\n";
-    Simulator::Schedule(MilliSeconds(100), &LogQueue1Size, queueDisc);
+    if(opt.useRollups){
+        queueRollups.Add("q1", qsize);
+    }
+    else{
+        q1Size << Simulator::Now().GetMilliSeconds() << "," << qsize << "\n";
+    }
+    Simulator::Schedule(Seconds(opt.sampleInterval / 1000), &LogQueue1Size, queueDisc);
 }
 
 void LogQueue2Size(Ptr<QueueDisc> queueDisc){
     uint32_t qsize = queueDisc->GetNPackets();
-    q2Size << Simulator::Now().GetMilliSeconds() << "," << qsize << "\n";
-    Simulator::Schedule(MilliSeconds(100), &LogQueue2Size, queueDisc);
+    if(opt.useRollups){
+        queueRollups.Add("q2", qsize);
+    }
+    else{
+        q2Size << Simulator::Now().GetMilliSeconds() << "," << qsize << "\n";
+    }
+    Simulator::Schedule(Seconds(opt.sampleInterval / 1000), &LogQueue2Size, queueDisc);
 }
 
 void LogThroughput(Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier){
@@ -91,15 +216,148 @@ void LogThroughput(Ptr<FlowMonitor> monitor, Ptr<Ipv4FlowClassifier> classifier)
         }
         uint32_t rxBytes = i->second.rxBytes - TotalRxBytes[i->first];
         TotalRxBytes[i->first] = i->second.rxBytes;
-        // Bytes sent during 100 ms interval, throughput in Mbps
-        double throughput_ = (rxBytes * 8.0) / 1e5;
-        throughput << Simulator::Now().GetMilliSeconds() << "," << t.sourceAddress << "," << t.sourcePort << "," << t.destinationAddress << "," << t.destinationPort << "," << throughput_ << "\n";
+        // Bytes sent during the sample interval, throughput in Mbps
+        double throughput_ = (rxBytes * 8.0) / (opt.sampleInterval * 1e3);
+        if(opt.useRollups){
+            std::ostringstream key;
+            key << t.sourceAddress << "," << t.sourcePort << "," << t.destinationAddress << "," << t.destinationPort;
+            throughputRollups.Add(key.str(), throughput_);
+        }
+        else{
+            throughput << Simulator::Now().GetMilliSeconds() << "," << t.sourceAddress << "," << t.sourcePort << "," << t.destinationAddress << "," << t.destinationPort << "," << throughput_ << "\n";
+        }
     }
 
-    Simulator::Schedule(MilliSeconds(100), &LogThroughput, monitor, classifier);
+    Simulator::Schedule(Seconds(opt.sampleInterval / 1000), &LogThroughput, monitor, classifier);
+}
+
+// The same options for the command line and for the sections of the scenario file
+void AddOptions(CommandLine& cmd){
+    cmd.AddValue("scenarios", "INI file of scenarios run one after the other in this process", scenarioFile);
+    cmd.AddValue("tcp", "TCP of every host, e.g. ns3::TcpCubic or ns3::TcpDctcp", opt.tcp);
+    cmd.AddValue("queueDisc", "Queue disc at r1r2 and psr2: pfifo (drop-tail) or red (ECN marking)", opt.queueDisc);
+    cmd.AddValue("duration", "Seconds of simulated time", opt.duration);
+    cmd.AddValue("suffix", "Appended to every output file name; in a scenario file, appended to the section's suffix (_<section> by default)", opt.suffix);
+    cmd.AddValue("segmentOffload", "Send 64KB super-segments, split at r1r2 and psr2 (not with DCTCP or red)", opt.useSegmentOffload);
+    cmd.AddValue("pfc", "Lossless fabric: PFC pause/resume on every link instead of drop-tail", opt.usePfc);
+    cmd.AddValue("pfcXoff", "PFC ingress XOFF threshold per port and priority (bytes)", opt.pfcXoff);
+    cmd.AddValue("pfcXon", "PFC ingress XON threshold per port and priority (bytes)", opt.pfcXon);
+    cmd.AddValue("fq", "Fair-queue pacing queue disc and TCP pacing on the worker and background hosts", opt.useFq);
+    cmd.AddValue("fqMaxRate", "Per-flow pacing cap of the host queue discs, 0bps for TCP pacing only", opt.fqMaxRate);
+    cmd.AddValue("transport", "Worker traffic: onoff, tcp, credit or trace", opt.transport);
+    cmd.AddValue("traceFile", "Flow log replayed with --transport=trace (start,src,dst,bytes,job[,iteration[,fct]])", opt.traceFile);
+    cmd.AddValue("gradientSize", "Bytes each worker sends to the PS per iteration (tcp, credit)", opt.gradientSize);
+    cmd.AddValue("computeTime", "Seconds of computation between iterations (tcp, credit)", opt.computeTime);
+    cmd.AddValue("captureWindow", "ms of packets written to pcap before a queue or drop incident at r1r2/psr2, 0 disables", opt.captureWindow);
+    cmd.AddValue("captureQueue", "Queue length (packets) at r1r2 or psr2 that triggers a capture", opt.captureQueue);
+    cmd.AddValue("flowAccounting", "flowmon, or streaming to write finished and idle flows to flows.csv and free them", opt.flowAccounting);
+    cmd.AddValue("sampleInterval", "ms between two queue and throughput samples", opt.sampleInterval);
+    cmd.AddValue("rollups", "Write min/max/mean/last rollups and an LTTB series instead of the raw samples", opt.useRollups);
+    cmd.AddValue("latencySample", "Tag 1 in N packets for the r1r2/psr2/wire latency breakdown, 0 disables", opt.latencySample);
+    cmd.AddValue("censusInterval", "Seconds between two samples of live objects and bytes per type, 0 disables", opt.censusInterval);
+    cmd.AddValue("intSample", "Carry per-hop queue, egress time and utilization of the routers in 1 in N packets, 0 disables", opt.intSample);
+    cmd.AddValue("progressFile", "Memory-mapped file that holds the live progress line", opt.progressFile);
+}
+
+std::string OutputName(std::string base, std::string extension = ".csv"){
+    return base + opt.suffix + extension;
+}
+
+std::string Trim(std::string s){
+    size_t begin = s.find_first_not_of(" \t\r");
+    if(begin == std::string::npos){
+        return "";
+    }
+    return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
 }
 
-int main(){
+// Sections of an INI file as command-line arguments: "[name]" starts a scenario, "key = value" sets the
+// option --key (ns-3 attributes and globals such as RngRun included), # and ; start comments. Keys
+// before the first section apply to every scenario.
+std::vector<std::pair<std::string, std::vector<std::string>>> ReadScenarios(std::string path){
+    std::ifstream in(path);
+    NS_ABORT_MSG_IF(!in.is_open(), "Cannot open the scenario file " << path);
+    std::vector<std::string> common;
+    std::vector<std::pair<std::string, std::vector<std::string>>> scenarios;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while(std::getline(in, line)){
+        lineNumber++;
+        line = Trim(line);
+        if(line.empty() || line[0] == '#' || line[0] == ';'){
+            continue;
+        }
+        if(line[0] == '['){
+            NS_ABORT_MSG_IF(line.back() != ']', path << ":" << lineNumber << ": unterminated section name");
+            scenarios.push_back(std::make_pair(Trim(line.substr(1, line.size() - 2)), common));
+            continue;
+        }
+        size_t equals = line.find('=');
+        NS_ABORT_MSG_IF(equals == std::string::npos, path << ":" << lineNumber << ": expected key = value");
+        std::string key = Trim(line.substr(0, equals));
+        NS_ABORT_MSG_IF(scenarios.empty() && key == "suffix",
+                        path << ":" << lineNumber << ": a suffix before the first section would give every scenario the same outputs");
+        std::string arg = "--" + key + "=" + Trim(line.substr(equals + 1));
+        if(scenarios.empty()){
+            common.push_back(arg);
+        }
+        else{
+            scenarios.back().second.push_back(arg);
+        }
+    }
+    return scenarios;
+}
+
+// First random stream of the scenario, from its output suffix, so a section draws the same
+// streams whether it runs alone or after other sections. Each scenario gets 100000 streams.
+int64_t StreamBase(){
+    uint32_t hash = 2166136261u;
+    for(char c : opt.suffix){
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return int64_t(hash % 100000) * 100000;
+}
+
+// Fixed streams for the stack (routing, ARP, TCP), the RED queue discs and every OnOff application
+void AssignScenarioStreams(NodeContainer nodes, QueueDiscContainer qdiscs){
+    int64_t stream = StreamBase();
+    InternetStackHelper stack;
+    stream += stack.AssignStreams(nodes, stream);
+    for(uint32_t i = 0; i < qdiscs.GetN(); i++){
+        Ptr<RedQueueDisc> red = DynamicCast<RedQueueDisc>(qdiscs.Get(i));
+        if(red){
+            stream += red->AssignStreams(stream);
+        }
+    }
+    for(uint32_t n = 0; n < nodes.GetN(); n++){
+        for(uint32_t a = 0; a < nodes.Get(n)->GetNApplications(); a++){
+            Ptr<OnOffApplication> app = DynamicCast<OnOffApplication>(nodes.Get(n)->GetApplication(a));
+            if(app){
+                stream += app->AssignStreams(stream);
+            }
+        }
+    }
+}
+
+void RunScenario(){
+    if(opt.sampleInterval <= 0){
+        NS_FATAL_ERROR("sampleInterval must be positive, got " << opt.sampleInterval);
+    }
+    // Nothing of the previous scenario is left in the run state or in the allocated addresses
+    TotalRxBytes.clear();
+    onOffApps.clear();
+    sinkApps.clear();
+    iterationWorkers = NodeContainer();
+    workerCredit.clear();
+    psRxBytes.clear();
+    iteration = 0;
+    workersDone = 0;
+    queueRollups = RollupWriter();
+    throughputRollups = RollupWriter();
+    Ipv4AddressGenerator::Reset();
+    // Variables without a fixed stream (sockets, error models, ...) draw the same automatic streams
+    RngSeedManager::ResetNextStreamIndex();
+
     // Create nodes
     NodeContainer worker, ps, router, background;
     worker.Create(2);
@@ -107,10 +365,21 @@ int main(){
     router.Create(2);
     background.Create(4);
 
-    Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue("ns3::TcpCubic"));
+    Config::SetDefault("ns3::TcpL4Protocol::SocketType", StringValue(opt.tcp));
     Config::SetDefault("ns3::TcpSocket::InitialCwnd", UintegerValue(10));
     Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(1448));
     Config::SetDefault("ns3::TcpSocket::DelAckCount", UintegerValue(1));
+    SegmentOffloadHelper offload(1448);
+    if(opt.useSegmentOffload){
+        SegmentOffloadHelper::RequireNoMarking(opt.tcp, opt.queueDisc == "red");
+        offload.ConfigureTcpDefaults(10);
+    }
+    if(opt.usePfc && opt.useFq){
+        NS_FATAL_ERROR("--pfc already installs the host queue discs, it cannot be combined with --fq");
+    }
+    if(opt.useFq){
+        Config::SetDefault("ns3::TcpSocketState::EnablePacing", BooleanValue(true));
+    }
     GlobalValue::Bind("ChecksumEnabled", BooleanValue(true));
 
     // Create links
@@ -134,6 +403,19 @@ int main(){
     b3r2 = p2p.Install(router.Get(1), background.Get(2));
     b4r2 = p2p.Install(router.Get(1), background.Get(3));
 
+    if(opt.useSegmentOffload){
+        // Host ends of the access links carry super-segments, the routers split them
+        offload.EnableOnHostDevice(w1r1.Get(1));
+        offload.EnableOnHostDevice(w2r1.Get(1));
+        offload.EnableOnHostDevice(psr2.Get(1));
+        offload.EnableOnHostDevice(b1r1.Get(1));
+        offload.EnableOnHostDevice(b2r1.Get(1));
+        offload.EnableOnHostDevice(b3r2.Get(1));
+        offload.EnableOnHostDevice(b4r2.Get(1));
+        offload.SetCongestionPoint(r1r2);
+        offload.SetCongestionPoint(psr2.Get(0));
+    }
+
     // Install internet stack
     InternetStackHelper stack;
     stack.Install(worker);
@@ -143,10 +425,59 @@ int main(){
 
     // Install Traffic Control for observing queue sizes
     TrafficControlHelper tch;
-    tch.SetRootQueueDisc("ns3::PfifoFastQueueDisc", "MaxSize", StringValue("100p"));
+    if(opt.queueDisc == "red"){
+        // ECN marking from 40 packets, up to 100% at 70 and gently above
+        tch.SetRootQueueDisc("ns3::RedQueueDisc",
+                            "MinTh", DoubleValue(40),
+                            "MaxTh", DoubleValue(70),
+                            "LinkBandwidth", StringValue("1Gbps"),
+                            "LinkDelay", StringValue("200us"),
+                            "MaxSize", QueueSizeValue(QueueSize("100p")),
+                            "MeanPktSize", DoubleValue(1500),
+                            "Gentle", BooleanValue(true),
+                            "UseEcn", BooleanValue(true),
+                            "UseHardDrop", BooleanValue(false),
+                            "QW", DoubleValue(0.4));
+    }
+    else if(opt.queueDisc == "pfifo"){
+        tch.SetRootQueueDisc("ns3::PfifoFastQueueDisc", "MaxSize", StringValue("100p"));
+    }
+    else{
+        NS_FATAL_ERROR("Unknown queue disc " << opt.queueDisc);
+    }
     
-    QueueDiscContainer qd1 = tch.Install(r1r2);
-    QueueDiscContainer qd2 = tch.Install(psr2);
+    QueueDiscContainer qd1, qd2;
+    PfcHelper pfc;
+    if(opt.usePfc){
+        // Every port is pausable, so back-pressure reaches the workers and background hosts
+        pauseLog.open(OutputName("pfcPause"));
+        PfcSwitch::WriteLogHeader(pauseLog);
+        pfc.SetThresholds(opt.pfcXoff, opt.pfcXon);
+        pfc.SetLog(&pauseLog);
+        pfc.InstallLink(w1r1);
+        pfc.InstallLink(w2r1);
+        pfc.InstallLink(b1r1);
+        pfc.InstallLink(b2r1);
+        pfc.InstallLink(b3r2);
+        pfc.InstallLink(b4r2);
+        qd1 = pfc.InstallLink(r1r2);
+        qd2 = pfc.InstallLink(psr2);
+    }
+    else{
+        qd1 = tch.Install(r1r2);
+        qd2 = tch.Install(psr2);
+    }
+    if(opt.useFq){
+        // Host egress only, the router ports keep their queue discs
+        TrafficControlHelper fq;
+        fq.SetRootQueueDisc("ns3::FqPacingQueueDisc", "MaxRate", DataRateValue(DataRate(opt.fqMaxRate)));
+        fq.Install(w1r1.Get(1));
+        fq.Install(w2r1.Get(1));
+        fq.Install(b1r1.Get(1));
+        fq.Install(b2r1.Get(1));
+        fq.Install(b3r2.Get(1));
+        fq.Install(b4r2.Get(1));
+    }
 
     // Assign IP addresses
     Ipv4AddressHelper address;
@@ -176,50 +507,317 @@ int main(){
 
     Ipv4GlobalRoutingHelper::PopulateRoutingTables();
 
+    // Ingress accounting needs the IPv4 interfaces, so it comes after address assignment
+    Ptr<PfcSwitch> pfcR1, pfcR2;
+    if(opt.usePfc){
+        pfcR1 = pfc.InstallSwitch(router.Get(0));
+        pfcR2 = pfc.InstallSwitch(router.Get(1));
+    }
+
     // Create flows
     uint16_t port = 9;
-    // Worker 1 to PS
-    createApps(InetSocketAddress(psr2Iface.GetAddress(1), port), worker.Get(0), ps.Get(0), 900, 1500, 0.0, 50.0, 1, 1);
-    // Worker 2 to PS
-    createApps(InetSocketAddress(psr2Iface.GetAddress(1), port+1), worker.Get(1), ps.Get(0), 900, 1500, 0.0, 50.0, 1, 1);
+    TraceReplay replay;
+    if(opt.transport == "onoff"){
+        // Worker 1 to PS
+        createApps(InetSocketAddress(psr2Iface.GetAddress(1), port), worker.Get(0), ps.Get(0), 900, 1500, 0.0, opt.duration, 1, 1);
+        // Worker 2 to PS
+        createApps(InetSocketAddress(psr2Iface.GetAddress(1), port+1), worker.Get(1), ps.Get(0), 900, 1500, 0.0, opt.duration, 1, 1);
+    }
+    else if(opt.transport == "tcp" || opt.transport == "credit"){
+        iterationWorkers = worker;
+        psAddress = psr2Iface.GetAddress(1);
+        iterationTime.open(OutputName("iterationTime"));
+        iterationTime << "Iteration,Start(ms),Duration(ms)\n";
+        if(opt.transport == "tcp"){
+            PacketSinkHelper sinkHelper("ns3::TcpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), 20));
+            ApplicationContainer sinkApp = sinkHelper.Install(ps.Get(0));
+            sinkApp.Get(0)->TraceConnectWithoutContext("Rx", MakeCallback(&PsReceived));
+        }
+        else{
+            // RTT is three 200us hops each way, about 150KB in flight at 1Gbps
+            NodeContainer creditNodes(worker, ps);
+            for(uint32_t i=0;i<creditNodes.GetN();i++){
+                Ptr<CreditTransport> credit = CreateObject<CreditTransport>();
+                credit->Setup(100, DataRate("1Gbps"));
+                credit->SetRttBytes(150000);
+                credit->SetResendTimeout(MilliSeconds(5));
+                creditNodes.Get(i)->AddApplication(credit);
+                if(i < worker.GetN()){
+                    workerCredit.push_back(credit);
+                }
+                else{
+                    credit->SetMessageCallback(MakeCallback(&PsMessageReceived));
+                }
+            }
+        }
+        Simulator::Schedule(MilliSeconds(1), &StartIteration);
+    }
+    else if(opt.transport == "trace"){
+        // Hosts named as in this file keep their node, any other name is spread over all hosts
+        replay.MapHost("w1", worker.Get(0));
+        replay.MapHost("w2", worker.Get(1));
+        replay.MapHost("ps", ps.Get(0));
+        for(uint32_t i=0;i<background.GetN();i++){
+            replay.MapHost("b" + std::to_string(i+1), background.Get(i));
+        }
+        replay.SetHosts(NodeContainer(worker, ps, background));
+        traceFlows.open(OutputName("traceFlows"));
+        TraceReplay::WriteFlowHeader(traceFlows);
+        traceJobs.open(OutputName("traceJobs"));
+        TraceReplay::WriteJobHeader(traceJobs);
+        replay.SetFlowOutput(&traceFlows);
+        replay.SetJobOutput(&traceJobs);
+        replay.SetStartTime(MilliSeconds(1));
+        replay.Start(opt.traceFile);
+    }
+    else{
+        NS_FATAL_ERROR("Unknown transport " << opt.transport);
+    }
     // Background 1 to background 2 and background 3 to background 4
-    createBackgroundApps(InetSocketAddress(b2r1Iface.GetAddress(1), port), background.Get(0), background.Get(1), 100, 1500, 0.5, 50.0, 1, 0);
-    createBackgroundApps(InetSocketAddress(b4r2Iface.GetAddress(1), port), background.Get(3), background.Get(2), 100, 1500, 0.5, 50.0, 1, 0);
+    createBackgroundApps(InetSocketAddress(b2r1Iface.GetAddress(1), port), background.Get(0), background.Get(1), 100, 1500, 0.5, opt.duration, 1, 0);
+    createBackgroundApps(InetSocketAddress(b4r2Iface.GetAddress(1), port), background.Get(3), background.Get(2), 100, 1500, 0.5, opt.duration, 1, 0);
 
     // // Background 1 to background 3, 4
     port++;
-    createBackgroundApps(InetSocketAddress(b3r2Iface.GetAddress(1), port), background.Get(0), background.Get(2), 175, 1500, 0.5, 50.0, 1, 0);
-    createBackgroundApps(InetSocketAddress(b4r2Iface.GetAddress(1), port), background.Get(0), background.Get(3), 175, 1500, 0.5, 50.0, 1, 0);
+    createBackgroundApps(InetSocketAddress(b3r2Iface.GetAddress(1), port), background.Get(0), background.Get(2), 175, 1500, 0.5, opt.duration, 1, 0);
+    createBackgroundApps(InetSocketAddress(b4r2Iface.GetAddress(1), port), background.Get(0), background.Get(3), 175, 1500, 0.5, opt.duration, 1, 0);
 
     // // Background 2 to background 3, 4
     port++;
-    createBackgroundApps(InetSocketAddress(b3r2Iface.GetAddress(1), port), background.Get(1), background.Get(2), 175, 1500, 0.5, 50.0, 1, 0);
-    createBackgroundApps(InetSocketAddress(b4r2Iface.GetAddress(1), port), background.Get(1), background.Get(3), 175, 1500, 0.5, 50.0, 1, 0);
+    createBackgroundApps(InetSocketAddress(b3r2Iface.GetAddress(1), port), background.Get(1), background.Get(2), 175, 1500, 0.5, opt.duration, 1, 0);
+    createBackgroundApps(InetSocketAddress(b4r2Iface.GetAddress(1), port), background.Get(1), background.Get(3), 175, 1500, 0.5, opt.duration, 1, 0);
+
 
+    // With rollups the raw q1Size, q2Size and throughput files are not written at all
+    if(opt.useRollups){
+        queueRollups.Open(OutputName("queue", ""), "Queue", "QueueSize(Packets)");
+        throughputRollups.Open(OutputName("throughput", ""), "Source IP,Source Port,Dest IP,Dest Port", "Throughput(Mbps)");
+    }
+    else{
+        q1Size.open(OutputName("q1Size"));
+        q1Size << "Time(ms),QueueSize(Packets)\n";
 
-    q1Size.open("q1Size.csv");
-    q1Size << "Time(ms),QueueSize(Packets)\n";
+        q2Size.open(OutputName("q2Size"));
+        q2Size << "Time(ms),QueueSize(Packets)\n";
 
-    q2Size.open("q2Size.csv");
-    q2Size << "Time(ms),QueueSize(Packets)\n";
+        throughput.open(OutputName("throughput"));
+        throughput << "Time(ms),Source IP, Source Port, Dest IP, Dest Port,Throughput(Mbps)\n";
+    }
 
-    throughput.open("throughput.csv");
-    throughput << "Time(ms),Source IP, Source Port, Dest IP, Dest Port,Throughput(Mbps)\n";
+    heavyHitters.open(OutputName("heavyHitters"));
+    HeavyHitterProbe::WriteHeader(heavyHitters);
+
+    // Live instances and bytes per object type, pending events and socket buffers, to see what grows in long runs
+    MemoryCensus census;
+    if(opt.censusInterval > 0){
+        MemoryCensus::EnableEventCounting();
+        censusLog.open(OutputName("census"));
+        MemoryCensus::WriteHeader(censusLog);
+        census.SetOutput(&censusLog);
+        census.SetInterval(Seconds(opt.censusInterval));
+        census.AddGauge("map:TotalRxBytes", [](){ return (uint64_t)TotalRxBytes.size(); }, 48);
+        census.AddGauge("map:psRxBytes", [](){ return (uint64_t)psRxBytes.size(); }, 48);
+        census.Start();
+    }
 
     FlowMonitorHelper flowmon;
-    Ptr<FlowMonitor> monitor = flowmon.InstallAll();
-    Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier>(flowmon.GetClassifier());
+    StreamingFlowAccounting accounting;
+    if(opt.flowAccounting == "streaming"){
+        // Live memory follows the active flows, throughput.csv (or its rollups) keeps its format
+        flowRecords.open(OutputName("flows"));
+        StreamingFlowAccounting::WriteHeader(flowRecords);
+        accounting.SetOutput(&flowRecords);
+        if(opt.useRollups){
+            accounting.SetIntervalCallback([](const std::string& flow, double mbps){ throughputRollups.Add(flow, mbps); },
+                                           Seconds(opt.sampleInterval / 1000));
+        }
+        else{
+            accounting.SetIntervalOutput(&throughput, Seconds(opt.sampleInterval / 1000));
+        }
+        accounting.InstallAll();
+        accounting.Start();
+        if(opt.censusInterval > 0){
+            census.AddGauge("streaming-flows", [&accounting](){ return accounting.GetActive(); }, 112);
+        }
+    }
+    else if(opt.flowAccounting == "flowmon"){
+        Ptr<FlowMonitor> monitor = flowmon.InstallAll();
+        Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier>(flowmon.GetClassifier());
+        if(opt.censusInterval > 0){
+            census.AddFlowMonitor(monitor);
+        }
+        Simulator::Schedule(Seconds(opt.sampleInterval / 1000), &LogThroughput, monitor, classifier);
+    }
+    else{
+        NS_FATAL_ERROR("Unknown flow accounting " << opt.flowAccounting);
+    }
+
+    Simulator::Schedule(Seconds(opt.sampleInterval / 1000), &LogQueue1Size, qd1.Get(0));
+    Simulator::Schedule(Seconds(opt.sampleInterval / 1000), &LogQueue2Size, qd2.Get(0));
+
+    // Top-10 contributors to queue buildup at r1r2 (router 1) and psr2 (router 2)
+    HeavyHitterProbe r1r2Probe("r1r2");
+    HeavyHitterProbe psr2Probe("psr2");
+    r1r2Probe.SetMinBacklog(1);
+    psr2Probe.SetMinBacklog(1);
+    r1r2Probe.Attach(qd1.Get(0), heavyHitters, MilliSeconds(100));
+    psr2Probe.Attach(qd2.Get(0), heavyHitters, MilliSeconds(100));
+
+    // Full packet detail only around the moments the bottleneck queues fill up or drop
+    PcapRingCapture capture(OutputName("incident", ""), MilliSeconds(opt.captureWindow), 16384);
+    if(opt.captureWindow > 0){
+        captureLog.open(OutputName("captures"));
+        PcapRingCapture::WriteLogHeader(captureLog);
+        capture.SetLog(&captureLog);
+        capture.AddDevice(r1r2.Get(0), "r1r2");
+        capture.AddDevice(psr2.Get(0), "psr2");
+        capture.TriggerOnQueue(qd1.Get(0), opt.captureQueue);
+        capture.TriggerOnQueue(qd2.Get(0), opt.captureQueue);
+        capture.TriggerOnDrop(qd1.Get(0));
+        capture.TriggerOnDrop(qd2.Get(0));
+    }
+
+    // Where the delay of the DDL and background packets is spent: queueing at r1r2, at psr2, or on the wire
+    HopLatencyProbe latency(opt.latencySample);
+    if(opt.latencySample > 0){
+        latency.AddClass("ddl", Ipv4Address::GetAny(), psr2Iface.GetAddress(1));
+        latency.AddClass("background", b1r1Iface.GetAddress(1), Ipv4Address::GetAny());
+        latency.AddClass("background", b2r1Iface.GetAddress(1), Ipv4Address::GetAny());
+        latency.AddClass("background", b3r2Iface.GetAddress(1), Ipv4Address::GetAny());
+        latency.AddClass("background", b4r2Iface.GetAddress(1), Ipv4Address::GetAny());
+        latency.AddQueueDisc(qd1.Get(0), "r1r2");
+        latency.AddQueueDisc(qd2.Get(0), "psr2");
+        latency.Install(NodeContainer(worker, ps, background));
+        hopSamples.open(OutputName("hopSamples"));
+        latency.SetSampleOutput(&hopSamples);
+    }
+
+    // Queue state of every router port a sampled packet crosses, seen by its receiver and echoed to its sender
+    IntHelper telemetry(opt.intSample);
+    if(opt.intSample > 0){
+        intLog.open(OutputName("int"));
+        IntHelper::WriteLogHeader(intLog);
+        telemetry.SetLog(&intLog);
+        telemetry.InstallSwitches(router);
+        telemetry.InstallHosts(NodeContainer(worker, ps, background));
+    }
+
+    ProgressReporter progress(Seconds(opt.duration));
+    progress.EnableStatusFile(opt.progressFile);
+    progress.Start();
 
-    Simulator::Schedule(MilliSeconds(100), &LogQueue1Size, qd1.Get(0));
-    Simulator::Schedule(MilliSeconds(100), &LogQueue2Size, qd2.Get(0));
-    Simulator::Schedule(MilliSeconds(100), &LogThroughput, monitor, classifier);
+    QueueDiscContainer routerQdiscs;
+    routerQdiscs.Add(qd1);
+    routerQdiscs.Add(qd2);
+    AssignScenarioStreams(NodeContainer(worker, ps, router, background), routerQdiscs);
 
-    Simulator::Stop(Seconds(50.0));
+    Simulator::Stop(Seconds(opt.duration));
     Simulator::Run();
 
+    if(opt.transport == "trace"){
+        replay.Finish();
+        std::cout << "Trace flows started: " << replay.GetStarted() << ", completed: " << replay.GetCompleted()
+                  << ", skipped: " << replay.GetSkipped() << "\n";
+    }
+
+    if(opt.usePfc){
+        // Time each router spent pausing its upstream neighbours, priority 0 carries all traffic
+        Ptr<Ipv4> ipv4R1 = router.Get(0)->GetObject<Ipv4>();
+        Ptr<Ipv4> ipv4R2 = router.Get(1)->GetObject<Ipv4>();
+        std::cout << "PFC pause time (ms) at r1: w1 " << pfcR1->GetPausedTime(ipv4R1->GetInterfaceForDevice(w1r1.Get(0)), 0).GetMilliSeconds()
+                  << ", w2 " << pfcR1->GetPausedTime(ipv4R1->GetInterfaceForDevice(w2r1.Get(0)), 0).GetMilliSeconds()
+                  << ", b1 " << pfcR1->GetPausedTime(ipv4R1->GetInterfaceForDevice(b1r1.Get(0)), 0).GetMilliSeconds()
+                  << ", b2 " << pfcR1->GetPausedTime(ipv4R1->GetInterfaceForDevice(b2r1.Get(0)), 0).GetMilliSeconds() << "\n";
+        std::cout << "PFC pause time (ms) at r2: r1 " << pfcR2->GetPausedTime(ipv4R2->GetInterfaceForDevice(r1r2.Get(1)), 0).GetMilliSeconds()
+                  << ", b3 " << pfcR2->GetPausedTime(ipv4R2->GetInterfaceForDevice(b3r2.Get(0)), 0).GetMilliSeconds()
+                  << ", b4 " << pfcR2->GetPausedTime(ipv4R2->GetInterfaceForDevice(b4r2.Get(0)), 0).GetMilliSeconds() << "\n";
+        std::cout << "Packets dropped at r1r2: " << qd1.Get(0)->GetStats().nTotalDroppedPackets
+                  << ", at psr2: " << qd2.Get(0)->GetStats().nTotalDroppedPackets << "\n";
+    }
+
+    if(opt.useRollups){
+        queueRollups.Finish();
+        throughputRollups.Finish();
+        std::cout << "Rollup rows: " << queueRollups.GetRows() + throughputRollups.GetRows() << "\n";
+    }
+    if(opt.flowAccounting == "streaming"){
+        accounting.Finish();
+        std::cout << "Flow records: " << accounting.GetExported() << ", peak active: " << accounting.GetPeakActive() << "\n";
+    }
+    if(opt.censusInterval > 0){
+        census.Finish();
+        censusPeakLog.open(OutputName("censusPeaks"));
+        MemoryCensus::WritePeaksHeader(censusPeakLog);
+        census.WritePeaks(censusPeakLog);
+        std::cout << "Peak resident memory: " << census.GetPeakBytes("rss") / 1e6 << " MB\n";
+    }
+    if(opt.latencySample > 0){
+        hopLatency.open(OutputName("hopLatency"));
+        HopLatencyProbe::WriteHeader(hopLatency);
+        latency.Write(hopLatency);
+        std::cout << "Latency samples tagged: " << latency.GetTagged() << ", delivered: " << latency.GetDelivered() << "\n";
+    }
+    if(opt.intSample > 0){
+        std::cout << "Telemetry packets sent: " << telemetry.GetSent() << ", delivered: " << telemetry.GetDelivered()
+                  << ", echoed: " << telemetry.GetEchoes() << "\n";
+    }
+    if(opt.captureWindow > 0){
+        std::cout << "Incident captures: " << capture.GetCaptures() << ", suppressed triggers: " << capture.GetSuppressed() << "\n";
+    }
+
     Simulator::Destroy();
 
     q1Size.close();
     q2Size.close();
     throughput.close();
+    heavyHitters.close();
+    pauseLog.close();
+    iterationTime.close();
+    traceFlows.close();
+    traceJobs.close();
+    captureLog.close();
+    flowRecords.close();
+    hopLatency.close();
+    hopSamples.close();
+    censusLog.close();
+    censusPeakLog.close();
+    intLog.close();
+}
+
+int main(int argc, char* argv[]){
+    CommandLine cmd(__FILE__);
+    AddOptions(cmd);
+    cmd.Parse(argc, argv);
+    if(scenarioFile.empty()){
+        RunScenario();
+        return 0;
+    }
+
+    // Every scenario starts from the defaults, then takes its section and the command line, which wins.
+    // A --suffix on the command line is appended to the suffix of each section, so scenarios keep
+    // distinct outputs and random streams.
+    std::string commandSuffix = opt.suffix;
+    std::vector<std::pair<std::string, std::vector<std::string>>> scenarios = ReadScenarios(scenarioFile);
+    for(uint32_t i=0;i<scenarios.size();i++){
+        Config::Reset();
+        opt = Scenario();
+        opt.suffix = "_" + scenarios[i].first;
+        std::vector<std::string> args(1, argv[0]);
+        args.insert(args.end(), scenarios[i].second.begin(), scenarios[i].second.end());
+        CommandLine sectionCmd(__FILE__);
+        AddOptions(sectionCmd);
+        sectionCmd.Parse(args);
+        std::string sectionSuffix = opt.suffix;
+        CommandLine scenarioCmd(__FILE__);
+        AddOptions(scenarioCmd);
+        scenarioCmd.Parse(argc, argv);
+        opt.suffix = sectionSuffix + commandSuffix;
+
+        std::cout << "Scenario " << scenarios[i].first << " (" << i + 1 << "/" << scenarios.size() << ")\n";
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RunScenario();
+        std::cout << "Scenario " << scenarios[i].first << " done in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+    }
+    return 0;
 }
\ No newline at end of file
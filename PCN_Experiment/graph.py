@@ -20,32 +20,38 @@ plt.grid()
 plt.savefig(path + 'queue_sizes.png')
 plt.close()  # Close the figure after saving to avoid overlap
 
-# throughput.csv
-throughput = np.genfromtxt(os.path.join(path, 'throughput_ECN.csv'), delimiter=',', dtype=str)
+# throughput.csv, grouped per flow by the trace analyzer (see the README):
+#   trace-analyzer throughput Results/ECN/throughput_ECN.csv
+series = np.loadtxt(os.path.join(path, 'throughput_ECN_series.csv'), skiprows=1, delimiter=',', ndmin=2)
+summary = np.genfromtxt(os.path.join(path, 'throughput_ECN_summary.csv'), names=True, delimiter=',', dtype=None, encoding=None, ndmin=1)
 flows = {
-    "Flow 1": {"src_ip": "192.168.1.2", "data": {}, "color": "blue", "label": "Main Flow 1"},
-    "Flow 2": {"src_ip": "192.168.2.2", "data": {}, "color": "orange", "label": "Main Flow 2"},
-    "Flow 3": {"src_ip": "192.168.5.2", "dst_ip": "192.168.6.2", "data": {}, "color": "purple", "label": "Background Flow 1"},
-    "Flow 4": {"src_ip": "192.168.7.2", "dst_ip": "192.168.8.2", "data": {}, "color": "red", "label": "Background Flow 2"},
-    "Flow 5": {"src_ip": "192.168.5.2", "dst_ip": "192.168.7.2", "data": {}, "color": "brown", "label": "Background Flow 3"},
-    "Flow 6": {"src_ip": "192.168.5.2", "dst_ip": "192.168.8.2", "data": {}, "color": "gray", "label": "Background Flow 4"},
-    "Flow 7": {"src_ip": "192.168.6.2", "dst_ip": "192.168.7.2", "data": {}, "color": "pink", "label": "Background Flow 5"},
-    "Flow 8": {"src_ip": "192.168.6.2", "dst_ip": "192.168.8.2", "data": {}, "color": "cyan", "label": "Background Flow 6"},
+    "Flow 1": {"src_ip": "192.168.1.2", "color": "blue", "label": "Main Flow 1"},
+    "Flow 2": {"src_ip": "192.168.2.2", "color": "orange", "label": "Main Flow 2"},
+    "Flow 3": {"src_ip": "192.168.5.2", "dst_ip": "192.168.6.2", "color": "purple", "label": "Background Flow 1"},
+    "Flow 4": {"src_ip": "192.168.7.2", "dst_ip": "192.168.8.2", "color": "red", "label": "Background Flow 2"},
+    "Flow 5": {"src_ip": "192.168.5.2", "dst_ip": "192.168.7.2", "color": "brown", "label": "Background Flow 3"},
+    "Flow 6": {"src_ip": "192.168.5.2", "dst_ip": "192.168.8.2", "color": "gray", "label": "Background Flow 4"},
+    "Flow 7": {"src_ip": "192.168.6.2", "dst_ip": "192.168.7.2", "color": "pink", "label": "Background Flow 5"},
+    "Flow 8": {"src_ip": "192.168.6.2", "dst_ip": "192.168.8.2", "color": "cyan", "label": "Background Flow 6"},
 }
 
-# Organize throughput data per flow
-# Skip the first row
-for row in throughput[1:]:
-    time, src_ip, dst_ip, throughput_value = float(row[0]), row[1], row[3], float(row[5])
-    for flow_name, flow_info in flows.items():
-        if flow_info["src_ip"] == src_ip and flow_info.get("dst_ip", dst_ip) == dst_ip:
-            flow_info["data"][time] = throughput_value
+# Series rows of each 5-tuple are contiguous; the throughput of all matching 5-tuples (one per connection with
+# --transport=tcp, finished ones reporting 0) is summed per time
+for flow_name, flow_info in flows.items():
+    match = summary['Source_IP'] == flow_info["src_ip"]
+    if "dst_ip" in flow_info:
+        match &= summary['Dest_IP'] == flow_info["dst_ip"]
+    parts = [series[row['FirstRow']:row['FirstRow'] + row['Samples']] for row in summary[match]]
+    data = np.concatenate([series[:0]] + parts)
+    flow_info["times"], index = np.unique(data[:, 1], return_inverse=True)
+    flow_info["values"] = np.zeros(len(flow_info["times"]))
+    np.add.at(flow_info["values"], index, data[:, 2])
 
 # Plotting throughput for each flow with distinct styles
 plt.figure(figsize=(12, 8))
 for flow_name, flow_info in flows.items():
-    times = list(flow_info["data"].keys())
-    values = list(flow_info["data"].values())
+    times = flow_info["times"]
+    values = flow_info["values"]
     if flow_name in ["Flow 1", "Flow 2"]:
         plt.plot(times, values, label=flow_info["label"], color=flow_info["color"], linewidth=2, alpha=1.0)
     else:
@@ -0,0 +1,701 @@
+/*
+Receiver-driven, credit-based message transport over UDP (Homa/NDP style).
+
+Every node that takes part runs one CreditTransport application on the same
+UDP port. A message is pushed with SendMessage(dest, size), or pulled with
+Request(server, size), which makes the server send a message of that size
+back (a query/response or parameter fetch).
+
+The sender transmits the first UnscheduledBytes of a message right away and
+then only what the receiver has granted. The receiver issues GRANTs paced at
+its downlink rate, one MSS of credit per MSS transmission time, so the
+scheduled traffic converging on it never exceeds its link. Credit goes to the
+message with the fewest remaining bytes (SRPT) among the Overcommit shortest
+ones, and a message never has more than RttBytes granted but not received.
+Senders also pace their own transmissions at their link rate and serve their
+messages in SRPT order.
+
+Losses are repaired by the receiver: when a message makes no progress for
+ResendTimeout it asks for the missing granted packets with RESEND, and a
+request that got no data is sent again, which makes the server queue the
+unscheduled packets again. Until the sender hears a GRANT or RESEND for a
+message it sends the unscheduled packets again every ResendTimeout, since
+the receiver knows nothing of a message whose unscheduled packets were all
+lost. A completed message is acknowledged with DONE, which frees it on the
+sender; duplicate data of a completed message is ignored and answered with
+DONE again. Completed ids are remembered for COMPLETED_HOLD resend timeouts.
+A credited message that hears no GRANT or RESEND for STATUS_AFTER resend
+timeouts (its DONE was lost, say) sends STATUS, which the receiver answers
+with DONE if it completed the message and with its current GRANT if the
+message is still in progress; after STATUS_PROBES unanswered STATUS the
+sender frees the message.
+
+Packets carry no priority field: all traffic shares the existing FIFO
+queues, so this models the credit scheduling but not Homa's in-network
+priorities.
+*/
+
+#ifndef CREDIT_TRANSPORT_H
+#define CREDIT_TRANSPORT_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/applications-module.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace ns3
+{
+
+class CreditHeader : public Header
+{
+  public:
+    enum Type
+    {
+        DATA = 0,
+        GRANT = 1,
+        RESEND = 2,
+        REQUEST = 3,
+        DONE = 4,
+        STATUS = 5
+    };
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid = TypeId("ns3::CreditHeader")
+                                .SetParent<Header>()
+                                .SetGroupName("Applications")
+                                .AddConstructor<CreditHeader>();
+        return tid;
+    }
+
+    TypeId GetInstanceTypeId() const override
+    {
+        return GetTypeId();
+    }
+
+    uint32_t GetSerializedSize() const override
+    {
+        return 17;
+    }
+
+    void Serialize(Buffer::Iterator start) const override
+    {
+        start.WriteU8(type);
+        start.WriteHtonU32(id);
+        start.WriteHtonU32(offset);
+        start.WriteHtonU32(length);
+        start.WriteHtonU32(messageSize);
+    }
+
+    uint32_t Deserialize(Buffer::Iterator start) override
+    {
+        type = start.ReadU8();
+        id = start.ReadNtohU32();
+        offset = start.ReadNtohU32();
+        length = start.ReadNtohU32();
+        messageSize = start.ReadNtohU32();
+        return GetSerializedSize();
+    }
+
+    void Print(std::ostream& os) const override
+    {
+        os << "type=" << (uint32_t)type << " id=" << id << " offset=" << offset << " length=" << length
+           << " messageSize=" << messageSize;
+    }
+
+    uint8_t type = DATA;
+    uint32_t id = 0;
+    uint32_t offset = 0; // DATA/RESEND: first byte, GRANT: bytes granted so far
+    uint32_t length = 0;
+    uint32_t messageSize = 0;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(CreditHeader);
+
+class CreditTransport : public Application
+{
+  public:
+    // Ids of requested messages are allocated by the receiver and have this bit set
+    static const uint32_t REQUESTED = 0x80000000;
+    // Credit header, UDP, IPv4 and PPP bytes on the wire per packet
+    static const uint32_t WIRE_OVERHEAD = 17 + 8 + 20 + 2;
+    // Resend timeouts a completed message id is kept to filter late duplicates
+    static const uint32_t COMPLETED_HOLD = 16;
+    // Silent resend timeouts before a credited message asks for its status, and STATUS sent before it is freed
+    static const uint32_t STATUS_AFTER = 3;
+    static const uint32_t STATUS_PROBES = 4;
+
+    typedef Callback<void, Ipv4Address, uint32_t, uint32_t> MessageCallback;
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid = TypeId("ns3::CreditTransport")
+                                .SetParent<Application>()
+                                .SetGroupName("Applications")
+                                .AddConstructor<CreditTransport>();
+        return tid;
+    }
+
+    CreditTransport()
+        : m_port(100),
+          m_linkRate("1Gbps"),
+          m_mss(1400),
+          m_unscheduledBytes(10 * 1400),
+          m_rttBytes(64 * 1400),
+          m_overcommit(2),
+          m_resendTimeout(MilliSeconds(10)),
+          m_nextId(0),
+          m_resends(0),
+          m_abandoned(0)
+    {
+    }
+
+    void Setup(uint16_t port, DataRate linkRate)
+    {
+        m_port = port;
+        m_linkRate = linkRate;
+    }
+
+    void SetMss(uint32_t mss)
+    {
+        m_mss = mss;
+    }
+
+    void SetUnscheduledBytes(uint32_t bytes)
+    {
+        m_unscheduledBytes = bytes;
+    }
+
+    void SetRttBytes(uint32_t bytes)
+    {
+        m_rttBytes = bytes;
+    }
+
+    void SetOvercommit(uint32_t messages)
+    {
+        m_overcommit = std::max(messages, 1u);
+    }
+
+    void SetResendTimeout(Time timeout)
+    {
+        m_resendTimeout = timeout;
+    }
+
+    // Called on the receiver for every completed message with (sender, id, size)
+    void SetMessageCallback(MessageCallback callback)
+    {
+        m_messageCallback = callback;
+    }
+
+    uint32_t SendMessage(Ipv4Address dest, uint32_t size)
+    {
+        uint32_t id = m_nextId++ & ~REQUESTED;
+        StartMessage(dest, id, size);
+        return id;
+    }
+
+    // Ask server to send a message of size bytes to this node
+    uint32_t Request(Ipv4Address server, uint32_t size)
+    {
+        uint32_t id = m_nextId++ | REQUESTED;
+        PendingRequest& request = m_requests[Key(server, id)];
+        request.size = size;
+        request.sent = Simulator::Now();
+        SendRequest(server, id, size);
+        ArmTimeouts();
+        return id;
+    }
+
+    uint64_t GetResends() const
+    {
+        return m_resends;
+    }
+
+    // Messages freed after STATUS_PROBES unanswered STATUS
+    uint64_t GetAbandoned() const
+    {
+        return m_abandoned;
+    }
+
+  private:
+    struct OutMessage
+    {
+        Ipv4Address dest;
+        uint32_t id;
+        uint32_t size;
+        uint32_t sentOffset;
+        uint32_t granted;
+        bool credited; // a GRANT or RESEND arrived, the receiver knows the message
+        Time lastSent;
+        Time lastHeard; // last GRANT, RESEND or STATUS sent
+        uint32_t probes; // STATUS sent since the last GRANT or RESEND
+        std::deque<uint32_t> resend;
+    };
+
+    struct InMessage
+    {
+        uint32_t size;
+        uint32_t granted;
+        uint32_t received;
+        Time lastProgress;
+        std::vector<bool> arrived;
+    };
+
+    struct PendingRequest
+    {
+        uint32_t size;
+        Time sent;
+    };
+
+    static uint64_t Key(Ipv4Address peer, uint32_t id)
+    {
+        return uint64_t(peer.Get()) << 32 | id;
+    }
+
+    void StartApplication() override
+    {
+        m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+        m_socket->Bind(InetSocketAddress(Ipv4Address::GetAny(), m_port));
+        m_socket->SetRecvCallback(MakeCallback(&CreditTransport::HandleRead, this));
+    }
+
+    void StopApplication() override
+    {
+        m_transmitEvent.Cancel();
+        m_grantEvent.Cancel();
+        m_timeoutEvent.Cancel();
+        if (m_socket)
+        {
+            m_socket->Close();
+        }
+    }
+
+    void StartMessage(Ipv4Address dest, uint32_t id, uint32_t size)
+    {
+        uint64_t key = Key(dest, id);
+        OutMessage& m = m_out[key];
+        m.dest = dest;
+        m.id = id;
+        m.size = size;
+        m.sentOffset = 0;
+        m.granted = std::min(size, m_unscheduledBytes);
+        m.credited = false;
+        m.lastSent = Simulator::Now();
+        m.lastHeard = Simulator::Now();
+        m.probes = 0;
+        m_active.insert(key);
+        ScheduleTransmit();
+        ArmTimeouts();
+    }
+
+    // Queue the unscheduled packets already sent for transmission again
+    void ResendUnscheduled(uint64_t key, OutMessage& m)
+    {
+        m.resend.clear();
+        uint32_t end = std::min(m.sentOffset, std::min(m.size, m_unscheduledBytes));
+        for (uint32_t offset = 0; offset < end; offset += m_mss)
+        {
+            m.resend.push_back(offset);
+        }
+        m_active.insert(key);
+        ScheduleTransmit();
+        m_resends++;
+    }
+
+    void SendControl(Ipv4Address to, const CreditHeader& header)
+    {
+        Ptr<Packet> packet = Create<Packet>();
+        packet->AddHeader(header);
+        m_socket->SendTo(packet, 0, InetSocketAddress(to, m_port));
+    }
+
+    void SendRequest(Ipv4Address server, uint32_t id, uint32_t size)
+    {
+        CreditHeader header;
+        header.type = CreditHeader::REQUEST;
+        header.id = id;
+        header.messageSize = size;
+        SendControl(server, header);
+    }
+
+    void HandleRead(Ptr<Socket> socket)
+    {
+        Ptr<Packet> packet;
+        Address from;
+        while ((packet = socket->RecvFrom(from)))
+        {
+            Ipv4Address peer = InetSocketAddress::ConvertFrom(from).GetIpv4();
+            CreditHeader header;
+            packet->RemoveHeader(header);
+            switch (header.type)
+            {
+            case CreditHeader::DATA:
+                OnData(peer, header);
+                break;
+            case CreditHeader::GRANT:
+            case CreditHeader::RESEND:
+                OnCredit(peer, header);
+                break;
+            case CreditHeader::REQUEST: {
+                // A repeated request means no data reached the client
+                uint64_t key = Key(peer, header.id);
+                std::map<uint64_t, OutMessage>::iterator it = m_out.find(key);
+                if (it == m_out.end())
+                {
+                    StartMessage(peer, header.id, header.messageSize);
+                }
+                else if (!it->second.credited)
+                {
+                    ResendUnscheduled(key, it->second);
+                }
+                break;
+            }
+            case CreditHeader::DONE: {
+                uint64_t key = Key(peer, header.id);
+                m_out.erase(key);
+                m_active.erase(key);
+                break;
+            }
+            case CreditHeader::STATUS: {
+                // A message still in progress (starved by SRPT, say) answers with its current grant
+                uint64_t key = Key(peer, header.id);
+                std::map<uint64_t, InMessage>::iterator it = m_in.find(key);
+                if (m_completed.count(key))
+                {
+                    SendDone(peer, header.id);
+                }
+                else if (it != m_in.end())
+                {
+                    CreditHeader grant;
+                    grant.type = CreditHeader::GRANT;
+                    grant.id = header.id;
+                    grant.offset = it->second.granted;
+                    SendControl(peer, grant);
+                }
+                break;
+            }
+            }
+        }
+    }
+
+    // Sender side
+
+    void ScheduleTransmit()
+    {
+        if (!m_transmitEvent.IsPending())
+        {
+            Time wait = std::max(m_nextTransmit - Simulator::Now(), Time(0));
+            m_transmitEvent = Simulator::Schedule(wait, &CreditTransport::Transmit, this);
+        }
+    }
+
+    void Transmit()
+    {
+        // SRPT over the messages that have granted bytes or repairs to send
+        OutMessage* best = nullptr;
+        for (std::set<uint64_t>::iterator it = m_active.begin(); it != m_active.end();)
+        {
+            OutMessage& m = m_out[*it];
+            if (m.resend.empty() && m.sentOffset >= m.size)
+            {
+                it = m_active.erase(it);
+                continue;
+            }
+            if (!m.resend.empty() || m.sentOffset < m.granted)
+            {
+                if (!best || m.size - m.sentOffset < best->size - best->sentOffset)
+                {
+                    best = &m;
+                }
+            }
+            ++it;
+        }
+        if (!best)
+        {
+            return;
+        }
+
+        uint32_t offset;
+        if (!best->resend.empty())
+        {
+            offset = best->resend.front();
+            best->resend.pop_front();
+        }
+        else
+        {
+            offset = best->sentOffset;
+            best->sentOffset = std::min(best->size, offset + m_mss);
+        }
+        CreditHeader header;
+        header.type = CreditHeader::DATA;
+        header.id = best->id;
+        header.offset = offset;
+        header.length = std::min(m_mss, best->size - offset);
+        header.messageSize = best->size;
+        best->lastSent = Simulator::Now();
+        Ptr<Packet> packet = Create<Packet>(header.length);
+        packet->AddHeader(header);
+        m_socket->SendTo(packet, 0, InetSocketAddress(best->dest, m_port));
+
+        m_nextTransmit = Simulator::Now() + m_linkRate.CalculateBytesTxTime(header.length + WIRE_OVERHEAD);
+        m_transmitEvent = Simulator::Schedule(m_nextTransmit - Simulator::Now(), &CreditTransport::Transmit, this);
+    }
+
+    void OnCredit(Ipv4Address peer, const CreditHeader& header)
+    {
+        uint64_t key = Key(peer, header.id);
+        std::map<uint64_t, OutMessage>::iterator it = m_out.find(key);
+        if (it == m_out.end())
+        {
+            return;
+        }
+        OutMessage& m = it->second;
+        m.credited = true;
+        m.lastHeard = Simulator::Now();
+        m.probes = 0;
+        if (header.type == CreditHeader::GRANT)
+        {
+            m.granted = std::max(m.granted, std::min(header.offset, m.size));
+        }
+        else
+        {
+            uint32_t end = std::min(header.offset + header.length, m.size);
+            for (uint32_t offset = header.offset; offset < end && offset < m.sentOffset; offset += m_mss)
+            {
+                m.resend.push_back(offset);
+            }
+            m.granted = std::max(m.granted, end);
+        }
+        m_active.insert(key);
+        ScheduleTransmit();
+    }
+
+    // Receiver side
+
+    void OnData(Ipv4Address peer, const CreditHeader& header)
+    {
+        uint64_t key = Key(peer, header.id);
+        if (m_completed.count(key))
+        {
+            SendDone(peer, header.id);
+            return;
+        }
+        std::map<uint64_t, InMessage>::iterator it = m_in.find(key);
+        if (it == m_in.end())
+        {
+            InMessage& m = m_in[key];
+            m.size = header.messageSize;
+            m.granted = std::min(header.messageSize, m_unscheduledBytes);
+            m.received = 0;
+            m.arrived.assign((header.messageSize + m_mss - 1) / m_mss, false);
+            m_requests.erase(key);
+            it = m_in.find(key);
+            ArmTimeouts();
+        }
+        InMessage& m = it->second;
+        uint32_t index = header.offset / m_mss;
+        if (index >= m.arrived.size() || m.arrived[index])
+        {
+            return;
+        }
+        m.arrived[index] = true;
+        m.received += header.length;
+        m.lastProgress = Simulator::Now();
+        if (m.received >= m.size)
+        {
+            m_in.erase(it);
+            m_completed[key] = Simulator::Now();
+            SendDone(peer, header.id);
+            if (!m_messageCallback.IsNull())
+            {
+                m_messageCallback(peer, header.id, header.messageSize);
+            }
+            return;
+        }
+        ScheduleGrant();
+    }
+
+    void SendDone(Ipv4Address peer, uint32_t id)
+    {
+        CreditHeader header;
+        header.type = CreditHeader::DONE;
+        header.id = id;
+        SendControl(peer, header);
+    }
+
+    void ScheduleGrant()
+    {
+        if (!m_grantEvent.IsPending())
+        {
+            Time wait = std::max(m_nextGrant - Simulator::Now(), Time(0));
+            m_grantEvent = Simulator::Schedule(wait, &CreditTransport::Grant, this);
+        }
+    }
+
+    void Grant()
+    {
+        // The Overcommit shortest messages are eligible, the shortest with window room gets the credit
+        std::vector<std::pair<uint32_t, uint64_t>> candidates;
+        for (std::map<uint64_t, InMessage>::iterator it = m_in.begin(); it != m_in.end(); ++it)
+        {
+            if (it->second.granted < it->second.size)
+            {
+                candidates.push_back(std::make_pair(it->second.size - it->second.received, it->first));
+            }
+        }
+        uint32_t eligible = std::min<uint32_t>(m_overcommit, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + eligible, candidates.end());
+        for (uint32_t i = 0; i < eligible; i++)
+        {
+            InMessage& m = m_in[candidates[i].second];
+            if (m.granted - std::min(m.granted, m.received) >= m_rttBytes)
+            {
+                continue;
+            }
+            m.granted = std::min(m.size, m.granted + m_mss);
+            CreditHeader header;
+            header.type = CreditHeader::GRANT;
+            header.id = candidates[i].second & 0xffffffff;
+            header.offset = m.granted;
+            SendControl(Ipv4Address(candidates[i].second >> 32), header);
+
+            m_nextGrant = Simulator::Now() + m_linkRate.CalculateBytesTxTime(m_mss + WIRE_OVERHEAD);
+            m_grantEvent = Simulator::Schedule(m_nextGrant - Simulator::Now(), &CreditTransport::Grant, this);
+            return;
+        }
+        // Every eligible message is window limited, the next data arrival restarts granting
+    }
+
+    void ArmTimeouts()
+    {
+        if (!m_timeoutEvent.IsPending())
+        {
+            m_timeoutEvent = Simulator::Schedule(m_resendTimeout, &CreditTransport::CheckTimeouts, this);
+        }
+    }
+
+    void CheckTimeouts()
+    {
+        Time now = Simulator::Now();
+        for (std::map<uint64_t, InMessage>::iterator it = m_in.begin(); it != m_in.end(); ++it)
+        {
+            InMessage& m = it->second;
+            if (now - m.lastProgress < m_resendTimeout)
+            {
+                continue;
+            }
+            // Ask again for the missing granted packets, at most one window of them
+            uint32_t limit = (m.granted + m_mss - 1) / m_mss;
+            uint32_t budget = std::max(m_rttBytes / m_mss, 1u);
+            for (uint32_t index = 0; index < limit && budget > 0; index++)
+            {
+                if (m.arrived[index])
+                {
+                    continue;
+                }
+                uint32_t first = index;
+                while (index < limit && !m.arrived[index] && budget > 0)
+                {
+                    index++;
+                    budget--;
+                }
+                CreditHeader header;
+                header.type = CreditHeader::RESEND;
+                header.id = it->first & 0xffffffff;
+                header.offset = first * m_mss;
+                header.length = (index - first) * m_mss;
+                SendControl(Ipv4Address(it->first >> 32), header);
+                m_resends++;
+            }
+            m.lastProgress = now;
+        }
+        for (std::map<uint64_t, PendingRequest>::iterator it = m_requests.begin(); it != m_requests.end(); ++it)
+        {
+            if (now - it->second.sent >= m_resendTimeout)
+            {
+                SendRequest(Ipv4Address(it->first >> 32), it->first & 0xffffffff, it->second.size);
+                it->second.sent = now;
+                m_resends++;
+            }
+        }
+        // Sender side: unscheduled packets nobody has heard of yet, and credited messages gone silent
+        for (std::map<uint64_t, OutMessage>::iterator it = m_out.begin(); it != m_out.end();)
+        {
+            OutMessage& m = it->second;
+            if (!m.credited && m.resend.empty() && m.sentOffset >= std::min(m.size, m_unscheduledBytes) &&
+                now - m.lastSent >= m_resendTimeout)
+            {
+                ResendUnscheduled(it->first, m);
+            }
+            else if (m.credited && m.resend.empty() &&
+                     now - std::max(m.lastHeard, m.lastSent) >= m_resendTimeout * (m.probes ? 1 : STATUS_AFTER))
+            {
+                if (m.probes >= STATUS_PROBES)
+                {
+                    m_active.erase(it->first);
+                    it = m_out.erase(it);
+                    m_abandoned++;
+                    continue;
+                }
+                CreditHeader header;
+                header.type = CreditHeader::STATUS;
+                header.id = m.id;
+                SendControl(m.dest, header);
+                m.lastHeard = now;
+                m.probes++;
+            }
+            ++it;
+        }
+        for (std::map<uint64_t, Time>::iterator it = m_completed.begin(); it != m_completed.end();)
+        {
+            if (now - it->second >= m_resendTimeout * COMPLETED_HOLD)
+            {
+                it = m_completed.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        if (!m_in.empty() || !m_requests.empty() || !m_out.empty() || !m_completed.empty())
+        {
+            m_timeoutEvent = Simulator::Schedule(m_resendTimeout, &CreditTransport::CheckTimeouts, this);
+        }
+    }
+
+    uint16_t m_port;
+    DataRate m_linkRate;
+    uint32_t m_mss;
+    uint32_t m_unscheduledBytes;
+    uint32_t m_rttBytes;
+    uint32_t m_overcommit;
+    Time m_resendTimeout;
+    MessageCallback m_messageCallback;
+
+    Ptr<Socket> m_socket;
+    uint32_t m_nextId;
+    uint64_t m_resends;
+    uint64_t m_abandoned;
+
+    std::map<uint64_t, OutMessage> m_out;
+    std::set<uint64_t> m_active;
+    EventId m_transmitEvent;
+    Time m_nextTransmit;
+
+    std::map<uint64_t, InMessage> m_in;
+    std::map<uint64_t, PendingRequest> m_requests;
+    std::map<uint64_t, Time> m_completed; // completion time
+    EventId m_grantEvent;
+    Time m_nextGrant;
+    EventId m_timeoutEvent;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,217 @@
+/*
+Setup-phase profiling and a lighter topology setup path.
+
+SetupProfiler times the phases before Simulator::Run() with a wall clock:
+Begin("stack") ends the previous phase and starts the next one, MarkRun()
+ends the last phase and schedules a zero-delay event, so the "first event"
+phase measures the time Run() needs to reach it (the time-0 events scheduled
+before it, such as application initialization, are included). Write() emits
+one CSV row per phase.
+
+FastAddressAssigner replaces per-link Ipv4AddressHelper::SetBase/Assign.
+Subnets are handed out sequentially from a base as plain integers, and each
+interface is added with one AddInterface/AddAddress/SetUp call. The global
+Ipv4AddressGenerator registry and the string parsing of SetBase are
+skipped, so it cannot detect collisions with addresses assigned elsewhere.
+Like Ipv4AddressHelper, it installs the default root queue disc on devices
+that have none, but the TrafficControlHelper for it is built once and reused.
+
+ConstantOnOffHelper returns an always-on OnOffHelper with its attributes set
+from values instead of strings. An experiment builds it once and only sets
+"Remote" before each Install.
+*/
+
+#ifndef FAST_SETUP_H
+#define FAST_SETUP_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ns3
+{
+
+class SetupProfiler
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    SetupProfiler()
+        : m_origin(Clock::now()),
+          m_running(false),
+          m_total(0)
+    {
+    }
+
+    void Begin(std::string phase)
+    {
+        End();
+        m_phase = phase;
+        m_start = Clock::now();
+        m_running = true;
+    }
+
+    void End()
+    {
+        if (m_running)
+        {
+            m_phases.push_back(std::make_pair(m_phase, Elapsed(m_start)));
+            m_running = false;
+        }
+    }
+
+    // Call right before Simulator::Run()
+    void MarkRun()
+    {
+        Begin("first event");
+        Simulator::ScheduleNow(&SetupProfiler::FirstEvent, this);
+    }
+
+    // Wall seconds from construction to the first event, 0 before it ran
+    double GetTotal() const
+    {
+        return m_total;
+    }
+
+    static void WriteHeader(std::ostream& out, std::string labelColumns)
+    {
+        out << labelColumns << (labelColumns.empty() ? "" : ",") << "Phase,Seconds\n";
+    }
+
+    void Write(std::ostream& out, std::string label) const
+    {
+        std::string prefix = label.empty() ? "" : label + ",";
+        for (const std::pair<std::string, double>& phase : m_phases)
+        {
+            out << prefix << phase.first << "," << phase.second << "\n";
+        }
+        out << prefix << "total," << m_total << "\n";
+    }
+
+  private:
+    static double Elapsed(Clock::time_point since)
+    {
+        return std::chrono::duration<double>(Clock::now() - since).count();
+    }
+
+    void FirstEvent()
+    {
+        End();
+        m_total = Elapsed(m_origin);
+    }
+
+    Clock::time_point m_origin;
+    Clock::time_point m_start;
+    std::string m_phase;
+    bool m_running;
+    double m_total;
+    std::vector<std::pair<std::string, double>> m_phases;
+};
+
+class FastAddressAssigner
+{
+  public:
+    // Subnets of 2^(32 - prefixLength) addresses starting at base
+    FastAddressAssigner(Ipv4Address base, uint32_t prefixLength)
+        : m_next(base.Get()),
+          m_prefixLength(prefixLength),
+          m_defaultQueueDisc(true)
+    {
+        NS_ABORT_MSG_IF(prefixLength < 8 || prefixLength > 30, "FastAddressAssigner needs a /8 to /30 prefix");
+    }
+
+    // Leave devices without a root queue disc (they send straight into the device queue)
+    void SetDefaultQueueDisc(bool enable)
+    {
+        m_defaultQueueDisc = enable;
+    }
+
+    // Next subnet; the devices get .1, .2, ... in container order
+    Ipv4InterfaceContainer Assign(const NetDeviceContainer& devices)
+    {
+        uint32_t size = 1u << (32 - m_prefixLength);
+        NS_ABORT_MSG_IF(devices.GetN() + 2 > size, "Too many devices for the subnet");
+        Ipv4Mask mask(~(size - 1));
+        Ipv4InterfaceContainer interfaces;
+        for (uint32_t i = 0; i < devices.GetN(); i++)
+        {
+            Ptr<NetDevice> device = devices.Get(i);
+            if (m_defaultQueueDisc)
+            {
+                InstallDefaultQueueDisc(device);
+            }
+            uint32_t iface = AddInterface(device, Ipv4Address(m_next + 1 + i), mask);
+            interfaces.Add(device->GetNode()->GetObject<Ipv4>(), iface);
+        }
+        m_next += size;
+        return interfaces;
+    }
+
+    // One interface with a fixed address, without a queue disc; returns its index
+    static uint32_t AddInterface(Ptr<NetDevice> device, Ipv4Address address, Ipv4Mask mask)
+    {
+        Ptr<Ipv4> ipv4 = device->GetNode()->GetObject<Ipv4>();
+        NS_ABORT_MSG_IF(!ipv4, "Install the internet stack before assigning addresses");
+        int32_t iface = ipv4->GetInterfaceForDevice(device);
+        if (iface == -1)
+        {
+            iface = ipv4->AddInterface(device);
+        }
+        ipv4->AddAddress(iface, Ipv4InterfaceAddress(address, mask));
+        ipv4->SetMetric(iface, 1);
+        ipv4->SetUp(iface);
+        return iface;
+    }
+
+  private:
+    // What Ipv4AddressHelper::Assign does, with the helper built once per queue count
+    void InstallDefaultQueueDisc(Ptr<NetDevice> device)
+    {
+        Ptr<TrafficControlLayer> tc = device->GetNode()->GetObject<TrafficControlLayer>();
+        if (!tc || tc->GetRootQueueDiscOnDevice(device))
+        {
+            return;
+        }
+        Ptr<NetDeviceQueueInterface> ndqi = device->GetObject<NetDeviceQueueInterface>();
+        if (!ndqi)
+        {
+            return;
+        }
+        std::size_t queues = ndqi->GetNTxQueues();
+        std::map<std::size_t, TrafficControlHelper>::iterator it = m_defaults.find(queues);
+        if (it == m_defaults.end())
+        {
+            it = m_defaults.emplace(queues, TrafficControlHelper::Default(queues)).first;
+        }
+        it->second.Install(device);
+    }
+
+    uint32_t m_next;
+    uint32_t m_prefixLength;
+    bool m_defaultQueueDisc;
+    std::map<std::size_t, TrafficControlHelper> m_defaults;
+};
+
+// Always-on OnOff source (1s on, no off time); set "Remote" for each application
+inline OnOffHelper ConstantOnOffHelper(std::string socketFactory, DataRate rate, uint32_t packetSize)
+{
+    OnOffHelper helper(socketFactory, Address());
+    helper.SetAttribute("DataRate", DataRateValue(rate));
+    helper.SetAttribute("PacketSize", UintegerValue(packetSize));
+    helper.SetAttribute("OnTime", PointerValue(CreateObjectWithAttributes<ConstantRandomVariable>("Constant", DoubleValue(1))));
+    helper.SetAttribute("OffTime", PointerValue(CreateObjectWithAttributes<ConstantRandomVariable>("Constant", DoubleValue(0))));
+    return helper;
+}
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,445 @@
+/*
+k-ary fat-tree builder with closed-form addressing and ECMP routing.
+
+A fat tree of even k has k pods of k/2 edge and k/2 aggregation switches,
+(k/2)^2 core switches and k^3/4 hosts (k = 16: 1024 hosts, 320 switches).
+Every link is a point-to-point /30 whose address is a function of its
+position, so nothing has to be discovered:
+    host link   pod p, edge e, host i   10.p.e.4i/30      (edge .1, host .2)
+    edge - agg  pod p, edge e, agg a    10.(128+p).e.4a/30 (edge .1, agg .2)
+    agg - core  pod p, agg a, core j    10.(64+p).a.4j/30  (agg .1, core .2)
+which limits k to 64.
+
+Hosts get a static default route to their edge switch. Switches run
+FatTreeRouting, which decodes pod, edge and host index straight from the
+destination address: a packet goes down when the destination is below the
+switch, otherwise up through one of the k/2 uplinks, picked per flow by a
+5-tuple hash (salted per switch, so the choice is independent at every
+layer) or per packet round robin (spraying). There is no global routing
+state and no Dijkstra; setup is linear in the number of links.
+*/
+
+#ifndef FAT_TREE_HELPER_H
+#define FAT_TREE_HELPER_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include "fast-setup.h"
+
+#include <utility>
+#include <vector>
+
+namespace ns3
+{
+
+class FatTreeRouting : public Ipv4RoutingProtocol
+{
+  public:
+    enum Role
+    {
+        EDGE,
+        AGGREGATION,
+        CORE
+    };
+
+    enum LoadBalancing
+    {
+        FLOW_HASH,
+        PACKET_SPRAY
+    };
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid = TypeId("ns3::FatTreeRouting")
+                                .SetParent<Ipv4RoutingProtocol>()
+                                .SetGroupName("Internet")
+                                .AddConstructor<FatTreeRouting>();
+        return tid;
+    }
+
+    FatTreeRouting()
+        : m_role(EDGE),
+          m_k(0),
+          m_pod(0),
+          m_index(0),
+          m_mode(FLOW_HASH),
+          m_salt(0),
+          m_spray(0)
+    {
+    }
+
+    // down: interfaces to hosts (edge), edges (aggregation) or pods (core), by index;
+    // up: the k/2 uplink interfaces
+    void Configure(Role role,
+                   uint32_t k,
+                   uint32_t pod,
+                   uint32_t index,
+                   std::vector<uint32_t> down,
+                   std::vector<uint32_t> up,
+                   LoadBalancing mode)
+    {
+        m_role = role;
+        m_k = k;
+        m_pod = pod;
+        m_index = index;
+        m_down = down;
+        m_up = up;
+        m_mode = mode;
+        m_salt = Hash32((uint32_t)role << 16 | pod << 8 | index);
+    }
+
+    Ptr<Ipv4Route> RouteOutput(Ptr<Packet> p,
+                               const Ipv4Header& header,
+                               Ptr<NetDevice> oif,
+                               Socket::SocketErrno& sockerr) override
+    {
+        int32_t iface = Lookup(p, header);
+        if (iface < 0)
+        {
+            sockerr = Socket::ERROR_NOROUTETOHOST;
+            return nullptr;
+        }
+        sockerr = Socket::ERROR_NOTERROR;
+        return MakeRoute(header.GetDestination(), iface);
+    }
+
+    bool RouteInput(Ptr<const Packet> p,
+                    const Ipv4Header& header,
+                    Ptr<const NetDevice> idev,
+                    const UnicastForwardCallback& ucb,
+                    const MulticastForwardCallback& mcb,
+                    const LocalDeliverCallback& lcb,
+                    const ErrorCallback& ecb) override
+    {
+        // Local delivery is handled by Ipv4ListRouting before the protocols are asked
+        int32_t iface = Lookup(p, header);
+        if (iface < 0)
+        {
+            return false;
+        }
+        ucb(MakeRoute(header.GetDestination(), iface), p, header);
+        return true;
+    }
+
+    void NotifyInterfaceUp(uint32_t interface) override
+    {
+    }
+
+    void NotifyInterfaceDown(uint32_t interface) override
+    {
+    }
+
+    void NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) override
+    {
+    }
+
+    void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) override
+    {
+    }
+
+    void SetIpv4(Ptr<Ipv4> ipv4) override
+    {
+        m_ipv4 = ipv4;
+    }
+
+    void PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit = Time::S) const override
+    {
+        static const char* roles[] = {"edge", "aggregation", "core"};
+        *stream->GetStream() << "Fat-tree " << roles[m_role] << " switch, pod " << m_pod << " index " << m_index
+                             << ", " << m_down.size() << " down and " << m_up.size() << " up interfaces, "
+                             << (m_mode == FLOW_HASH ? "flow hash" : "packet spray") << "\n";
+    }
+
+  private:
+    static uint32_t Hash32(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352d;
+        x ^= x >> 15;
+        x *= 0x846ca68b;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Output interface, or -1 when the destination is not a fat-tree host
+    int32_t Lookup(Ptr<const Packet> p, const Ipv4Header& header)
+    {
+        uint32_t dst = header.GetDestination().Get();
+        uint32_t pod = (dst >> 16) & 0xff;
+        uint32_t edge = (dst >> 8) & 0xff;
+        uint32_t host = (dst & 0xff) / 4;
+        if ((dst >> 24) != 10 || pod >= m_k || edge >= m_k / 2 || host >= m_k / 2)
+        {
+            return -1;
+        }
+        switch (m_role)
+        {
+        case EDGE:
+            if (pod == m_pod && edge == m_index)
+            {
+                return m_down[host];
+            }
+            return m_up[Uplink(p, header)];
+        case AGGREGATION:
+            if (pod == m_pod)
+            {
+                return m_down[edge];
+            }
+            return m_up[Uplink(p, header)];
+        case CORE:
+            return m_down[pod];
+        }
+        return -1;
+    }
+
+    uint32_t Uplink(Ptr<const Packet> p, const Ipv4Header& header)
+    {
+        if (m_mode == PACKET_SPRAY)
+        {
+            return m_spray++ % m_up.size();
+        }
+        uint32_t ports = 0;
+        uint8_t protocol = header.GetProtocol();
+        if (p && (protocol == 6 || protocol == 17) && header.GetFragmentOffset() == 0 && p->GetSize() >= 4)
+        {
+            uint8_t buf[4];
+            p->CopyData(buf, 4);
+            ports = (uint32_t)buf[0] << 24 | (uint32_t)buf[1] << 16 | (uint32_t)buf[2] << 8 | buf[3];
+        }
+        uint32_t h = Hash32(header.GetSource().Get() ^ m_salt);
+        h = Hash32(h ^ header.GetDestination().Get());
+        h = Hash32(h ^ ports ^ protocol);
+        return h % m_up.size();
+    }
+
+    Ptr<Ipv4Route> MakeRoute(Ipv4Address destination, uint32_t iface)
+    {
+        Ptr<Ipv4Route> route = Create<Ipv4Route>();
+        route->SetDestination(destination);
+        route->SetGateway(Ipv4Address::GetZero());
+        route->SetSource(m_ipv4->GetAddress(iface, 0).GetLocal());
+        route->SetOutputDevice(m_ipv4->GetNetDevice(iface));
+        return route;
+    }
+
+    Ptr<Ipv4> m_ipv4;
+    Role m_role;
+    uint32_t m_k;
+    uint32_t m_pod;
+    uint32_t m_index;
+    std::vector<uint32_t> m_down;
+    std::vector<uint32_t> m_up;
+    LoadBalancing m_mode;
+    uint32_t m_salt;
+    uint32_t m_spray;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(FatTreeRouting);
+
+class FatTreeHelper
+{
+  public:
+    FatTreeHelper(uint32_t k)
+        : m_k(k),
+          m_mode(FatTreeRouting::FLOW_HASH),
+          m_hasQueueDisc(false),
+          m_profiler(nullptr)
+    {
+        NS_ABORT_MSG_IF(k < 2 || k % 2 != 0 || k > 64, "Fat-tree k must be even and at most 64");
+        m_link.SetDeviceAttribute("DataRate", StringValue("1Gbps"));
+        m_link.SetChannelAttribute("Delay", StringValue("10us"));
+    }
+
+    void SetLinkHelper(PointToPointHelper link)
+    {
+        m_link = link;
+    }
+
+    // Queue disc for every switch port; hosts send straight into their device queue
+    void SetSwitchQueueDisc(TrafficControlHelper tch)
+    {
+        m_switchQueueDisc = tch;
+        m_hasQueueDisc = true;
+    }
+
+    void SetLoadBalancing(FatTreeRouting::LoadBalancing mode)
+    {
+        m_mode = mode;
+    }
+
+    // Build() reports its phases (nodes, stack, links, routing) to the profiler
+    void SetProfiler(SetupProfiler* profiler)
+    {
+        m_profiler = profiler;
+    }
+
+    void Build()
+    {
+        uint32_t half = m_k / 2;
+        Phase("nodes");
+        m_hosts.Create(m_k * half * half);
+        m_edges.Create(m_k * half);
+        m_aggs.Create(m_k * half);
+        m_cores.Create(half * half);
+
+        Phase("stack");
+        InternetStackHelper stack;
+        stack.Install(m_hosts);
+        stack.Install(m_edges);
+        stack.Install(m_aggs);
+        stack.Install(m_cores);
+
+        std::vector<std::vector<uint32_t>> edgeDown(m_k * half), edgeUp(m_k * half);
+        std::vector<std::vector<uint32_t>> aggDown(m_k * half), aggUp(m_k * half);
+        std::vector<std::vector<uint32_t>> coreDown(half * half, std::vector<uint32_t>(m_k));
+        Ipv4StaticRoutingHelper staticRouting;
+        Phase("links");
+
+        for (uint32_t p = 0; p < m_k; p++)
+        {
+            for (uint32_t e = 0; e < half; e++)
+            {
+                uint32_t edge = p * half + e;
+                for (uint32_t i = 0; i < half; i++)
+                {
+                    Ptr<Node> host = GetHost(p, e, i);
+                    uint32_t network = 10u << 24 | p << 16 | e << 8 | 4 * i;
+                    std::pair<uint32_t, uint32_t> ifaces = Connect(m_edges.Get(edge), host, network, true, false);
+                    edgeDown[edge].push_back(ifaces.first);
+                    staticRouting.GetStaticRouting(host->GetObject<Ipv4>())
+                        ->SetDefaultRoute(Ipv4Address(network + 1), ifaces.second);
+                }
+                for (uint32_t a = 0; a < half; a++)
+                {
+                    uint32_t agg = p * half + a;
+                    uint32_t network = 10u << 24 | (128 + p) << 16 | e << 8 | 4 * a;
+                    std::pair<uint32_t, uint32_t> ifaces = Connect(m_edges.Get(edge), m_aggs.Get(agg), network, true, true);
+                    edgeUp[edge].push_back(ifaces.first);
+                    aggDown[agg].push_back(ifaces.second);
+                }
+            }
+            for (uint32_t a = 0; a < half; a++)
+            {
+                uint32_t agg = p * half + a;
+                for (uint32_t j = 0; j < half; j++)
+                {
+                    uint32_t core = a * half + j;
+                    uint32_t network = 10u << 24 | (64 + p) << 16 | a << 8 | 4 * j;
+                    std::pair<uint32_t, uint32_t> ifaces = Connect(m_aggs.Get(agg), m_cores.Get(core), network, true, true);
+                    aggUp[agg].push_back(ifaces.first);
+                    coreDown[core][p] = ifaces.second;
+                }
+            }
+        }
+
+        Phase("routing");
+        for (uint32_t s = 0; s < m_k * half; s++)
+        {
+            AddRouting(m_edges.Get(s))->Configure(FatTreeRouting::EDGE, m_k, s / half, s % half, edgeDown[s], edgeUp[s], m_mode);
+            AddRouting(m_aggs.Get(s))->Configure(FatTreeRouting::AGGREGATION, m_k, s / half, s % half, aggDown[s], aggUp[s], m_mode);
+        }
+        for (uint32_t c = 0; c < half * half; c++)
+        {
+            AddRouting(m_cores.Get(c))->Configure(FatTreeRouting::CORE, m_k, 0, c, coreDown[c], std::vector<uint32_t>(), m_mode);
+        }
+    }
+
+    uint32_t GetNHosts() const
+    {
+        return m_hosts.GetN();
+    }
+
+    // Host n = (pod * k/2 + edge) * k/2 + index
+    Ptr<Node> GetHost(uint32_t n) const
+    {
+        return m_hosts.Get(n);
+    }
+
+    Ptr<Node> GetHost(uint32_t pod, uint32_t edge, uint32_t index) const
+    {
+        return m_hosts.Get((pod * m_k / 2 + edge) * m_k / 2 + index);
+    }
+
+    Ipv4Address GetHostAddress(uint32_t n) const
+    {
+        uint32_t half = m_k / 2;
+        uint32_t pod = n / (half * half);
+        uint32_t edge = n / half % half;
+        uint32_t index = n % half;
+        return Ipv4Address(10u << 24 | pod << 16 | edge << 8 | (4 * index + 2));
+    }
+
+    NodeContainer GetHosts() const
+    {
+        return m_hosts;
+    }
+
+    NodeContainer GetSwitches() const
+    {
+        return NodeContainer(m_edges, m_aggs, m_cores);
+    }
+
+    QueueDiscContainer GetSwitchQueueDiscs() const
+    {
+        return m_queueDiscs;
+    }
+
+  private:
+    void Phase(std::string name)
+    {
+        if (m_profiler)
+        {
+            m_profiler->Begin(name);
+        }
+    }
+
+    // Link a (.1) and b (.2) on the /30 at network; returns their interface indices
+    std::pair<uint32_t, uint32_t> Connect(Ptr<Node> a, Ptr<Node> b, uint32_t network, bool switchA, bool switchB)
+    {
+        NetDeviceContainer devices = m_link.Install(a, b);
+        if (m_hasQueueDisc)
+        {
+            if (switchA)
+            {
+                m_queueDiscs.Add(m_switchQueueDisc.Install(devices.Get(0)));
+            }
+            if (switchB)
+            {
+                m_queueDiscs.Add(m_switchQueueDisc.Install(devices.Get(1)));
+            }
+        }
+        Ipv4Mask mask("255.255.255.252");
+        return std::make_pair(FastAddressAssigner::AddInterface(devices.Get(0), Ipv4Address(network + 1), mask),
+                              FastAddressAssigner::AddInterface(devices.Get(1), Ipv4Address(network + 2), mask));
+    }
+
+    static Ptr<FatTreeRouting> AddRouting(Ptr<Node> node)
+    {
+        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+        Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting>(ipv4->GetRoutingProtocol());
+        NS_ABORT_MSG_IF(!list, "FatTreeHelper needs the default list routing of InternetStackHelper");
+        Ptr<FatTreeRouting> routing = CreateObject<FatTreeRouting>();
+        list->AddRoutingProtocol(routing, 10);
+        return routing;
+    }
+
+    uint32_t m_k;
+    FatTreeRouting::LoadBalancing m_mode;
+    PointToPointHelper m_link;
+    TrafficControlHelper m_switchQueueDisc;
+    bool m_hasQueueDisc;
+    NodeContainer m_hosts;
+    NodeContainer m_edges;
+    NodeContainer m_aggs;
+    NodeContainer m_cores;
+    QueueDiscContainer m_queueDiscs;
+    SetupProfiler* m_profiler;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,326 @@
+/*
+Per-flow accounting with eviction, for workloads with many short flows.
+
+FlowMonitor keeps the statistics and histograms of every flow until the end
+of the run. StreamingFlowAccounting keeps a record only while a flow is
+active. A flow is one direction of a 5-tuple, as in FlowMonitor. Its record
+is written to the flow output and freed in three cases: when a TCP FIN of
+the flow is delivered, when the flow has been idle for IdleTimeout, or at
+Finish(). Live memory is proportional to the number of concurrently active
+flows; the peak is reported by GetPeakActive(). A packet of an evicted
+flow (a retransmitted FIN, say) opens a new record.
+
+Install(nodes) hooks the Ipv4L3Protocol traces of the nodes: SendOutgoing
+counts the packets a node originates, LocalDeliver the packets it
+receives, and Drop the packets lost in the IP layer. Queue disc and device
+drops are not seen, so the loss of a flow is txPackets - rxPackets at
+eviction. With SetIntervalOutput(out, t) the receive rate of every flow
+that received bytes in the last t is also written every t, in the
+throughput.csv format of the PCN experiments; bytes of a flow evicted
+within an interval are only in its flow record. SetIntervalCallback(f, t)
+hands the same rates to f(flow, Mbps) instead, with flow written as
+"src,srcPort,dst,dstPort".
+*/
+
+#ifndef FLOW_ACCOUNTING_H
+#define FLOW_ACCOUNTING_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+
+class StreamingFlowAccounting
+{
+  public:
+    StreamingFlowAccounting()
+        : m_idleTimeout(Seconds(1)),
+          m_out(nullptr),
+          m_intervalOut(nullptr),
+          m_interval(Time(0)),
+          m_peakActive(0),
+          m_exported(0)
+    {
+    }
+
+    void SetIdleTimeout(Time timeout)
+    {
+        m_idleTimeout = timeout;
+    }
+
+    void SetOutput(std::ostream* out)
+    {
+        m_out = out;
+    }
+
+    void SetIntervalOutput(std::ostream* out, Time interval)
+    {
+        m_intervalOut = out;
+        m_interval = interval;
+    }
+
+    void SetIntervalCallback(std::function<void(const std::string&, double)> callback, Time interval)
+    {
+        m_intervalCallback = callback;
+        m_interval = interval;
+    }
+
+    static void WriteHeader(std::ostream& out)
+    {
+        out << "Source IP,Source Port,Dest IP,Dest Port,Protocol,Start(s),End(s),TxPackets,TxBytes,RxPackets,RxBytes,"
+               "IpDrops,Evicted\n";
+    }
+
+    void Install(NodeContainer nodes)
+    {
+        for (uint32_t i = 0; i < nodes.GetN(); i++)
+        {
+            Ptr<Ipv4L3Protocol> ipv4 = nodes.Get(i)->GetObject<Ipv4L3Protocol>();
+            NS_ABORT_MSG_IF(!ipv4, "Install the internet stack before the flow accounting");
+            ipv4->TraceConnectWithoutContext("SendOutgoing", MakeCallback(&StreamingFlowAccounting::OnSend, this));
+            ipv4->TraceConnectWithoutContext("LocalDeliver", MakeCallback(&StreamingFlowAccounting::OnDeliver, this));
+            ipv4->TraceConnectWithoutContext("Drop", MakeCallback(&StreamingFlowAccounting::OnDrop, this));
+        }
+    }
+
+    void InstallAll()
+    {
+        Install(NodeContainer::GetGlobal());
+    }
+
+    void Start()
+    {
+        Simulator::Schedule(m_idleTimeout / 2, &StreamingFlowAccounting::Sweep, this);
+        if ((m_intervalOut || m_intervalCallback) && m_interval.IsStrictlyPositive())
+        {
+            Simulator::Schedule(m_interval, &StreamingFlowAccounting::Interval, this);
+        }
+    }
+
+    // Writes and frees the records still active
+    void Finish()
+    {
+        for (std::unordered_map<Key, Record, KeyHash>::iterator it = m_flows.begin(); it != m_flows.end(); it++)
+        {
+            Export(it->first, it->second, "end");
+        }
+        m_flows.clear();
+    }
+
+    uint64_t GetActive() const
+    {
+        return m_flows.size();
+    }
+
+    uint64_t GetPeakActive() const
+    {
+        return m_peakActive;
+    }
+
+    uint64_t GetExported() const
+    {
+        return m_exported;
+    }
+
+  private:
+    struct Key
+    {
+        uint32_t src;
+        uint32_t dst;
+        uint16_t srcPort;
+        uint16_t dstPort;
+        uint8_t protocol;
+
+        bool operator==(const Key& other) const
+        {
+            return src == other.src && dst == other.dst && srcPort == other.srcPort && dstPort == other.dstPort &&
+                   protocol == other.protocol;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& k) const
+        {
+            uint64_t h = (uint64_t)k.src << 32 | k.dst;
+            h ^= ((uint64_t)k.srcPort << 24 | (uint64_t)k.dstPort << 8 | k.protocol) * 0x9e3779b97f4a7c15ULL;
+            h ^= h >> 29;
+            h *= 0xbf58476d1ce4e5b9ULL;
+            h ^= h >> 32;
+            return h;
+        }
+    };
+
+    struct Record
+    {
+        int64_t start; // ns
+        int64_t end;
+        int64_t last;
+        uint64_t txPackets;
+        uint64_t txBytes;
+        uint64_t rxPackets;
+        uint64_t rxBytes;
+        uint64_t intervalRxBytes;
+        uint32_t drops;
+    };
+
+    // Ports and TCP flags from the transport header at the start of the packet
+    static Key MakeKey(const Ipv4Header& header, Ptr<const Packet> packet, uint8_t* tcpFlags)
+    {
+        Key key;
+        key.src = header.GetSource().Get();
+        key.dst = header.GetDestination().Get();
+        key.protocol = header.GetProtocol();
+        key.srcPort = 0;
+        key.dstPort = 0;
+        *tcpFlags = 0;
+        if ((key.protocol == 6 || key.protocol == 17) && header.GetFragmentOffset() == 0 && packet->GetSize() >= 4)
+        {
+            uint8_t buf[14];
+            uint32_t n = packet->CopyData(buf, std::min<uint32_t>(packet->GetSize(), sizeof(buf)));
+            key.srcPort = (uint16_t)buf[0] << 8 | buf[1];
+            key.dstPort = (uint16_t)buf[2] << 8 | buf[3];
+            if (key.protocol == 6 && n == sizeof(buf))
+            {
+                *tcpFlags = buf[13];
+            }
+        }
+        return key;
+    }
+
+    Record& Find(const Key& key)
+    {
+        std::pair<std::unordered_map<Key, Record, KeyHash>::iterator, bool> it = m_flows.emplace(key, Record());
+        Record& r = it.first->second;
+        if (it.second)
+        {
+            std::memset(&r, 0, sizeof(r));
+            r.start = Simulator::Now().GetNanoSeconds();
+            m_peakActive = std::max<uint64_t>(m_peakActive, m_flows.size());
+        }
+        r.last = Simulator::Now().GetNanoSeconds();
+        return r;
+    }
+
+    void OnSend(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface)
+    {
+        uint8_t flags;
+        Record& r = Find(MakeKey(header, packet, &flags));
+        r.txPackets++;
+        r.txBytes += packet->GetSize() + header.GetSerializedSize();
+    }
+
+    void OnDeliver(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface)
+    {
+        uint8_t flags;
+        Key key = MakeKey(header, packet, &flags);
+        Record& r = Find(key);
+        uint32_t size = packet->GetSize() + header.GetSerializedSize();
+        r.rxPackets++;
+        r.rxBytes += size;
+        r.intervalRxBytes += size;
+        r.end = r.last;
+        if (flags & 0x01)
+        {
+            // FIN delivered: the sender has nothing more to send in this direction
+            Export(key, r, "fin");
+            m_flows.erase(key);
+        }
+    }
+
+    void OnDrop(const Ipv4Header& header,
+                Ptr<const Packet> packet,
+                Ipv4L3Protocol::DropReason reason,
+                Ptr<Ipv4> ipv4,
+                uint32_t interface)
+    {
+        uint8_t flags;
+        std::unordered_map<Key, Record, KeyHash>::iterator it = m_flows.find(MakeKey(header, packet, &flags));
+        if (it != m_flows.end())
+        {
+            it->second.drops++;
+        }
+    }
+
+    void Sweep()
+    {
+        int64_t limit = (Simulator::Now() - m_idleTimeout).GetNanoSeconds();
+        for (std::unordered_map<Key, Record, KeyHash>::iterator it = m_flows.begin(); it != m_flows.end();)
+        {
+            if (it->second.last < limit)
+            {
+                Export(it->first, it->second, "idle");
+                it = m_flows.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+        Simulator::Schedule(m_idleTimeout / 2, &StreamingFlowAccounting::Sweep, this);
+    }
+
+    void Interval()
+    {
+        int64_t now = Simulator::Now().GetMilliSeconds();
+        for (std::unordered_map<Key, Record, KeyHash>::iterator it = m_flows.begin(); it != m_flows.end(); it++)
+        {
+            if (it->second.intervalRxBytes == 0)
+            {
+                continue;
+            }
+            double mbps = it->second.intervalRxBytes * 8.0 / m_interval.GetSeconds() / 1e6;
+            if (m_intervalOut)
+            {
+                *m_intervalOut << now << "," << Ipv4Address(it->first.src) << "," << it->first.srcPort << ","
+                               << Ipv4Address(it->first.dst) << "," << it->first.dstPort << "," << mbps << "\n";
+            }
+            if (m_intervalCallback)
+            {
+                std::ostringstream flow;
+                flow << Ipv4Address(it->first.src) << "," << it->first.srcPort << "," << Ipv4Address(it->first.dst)
+                     << "," << it->first.dstPort;
+                m_intervalCallback(flow.str(), mbps);
+            }
+            it->second.intervalRxBytes = 0;
+        }
+        Simulator::Schedule(m_interval, &StreamingFlowAccounting::Interval, this);
+    }
+
+    void Export(const Key& key, const Record& r, const char* reason)
+    {
+        m_exported++;
+        if (!m_out)
+        {
+            return;
+        }
+        *m_out << Ipv4Address(key.src) << "," << key.srcPort << "," << Ipv4Address(key.dst) << "," << key.dstPort << ","
+               << (uint32_t)key.protocol << "," << r.start * 1e-9 << "," << std::max(r.end, r.start) * 1e-9 << ","
+               << r.txPackets << "," << r.txBytes << "," << r.rxPackets << "," << r.rxBytes << "," << r.drops << ","
+               << reason << "\n";
+    }
+
+    Time m_idleTimeout;
+    std::ostream* m_out;
+    std::ostream* m_intervalOut;
+    std::function<void(const std::string&, double)> m_intervalCallback;
+    Time m_interval;
+    std::unordered_map<Key, Record, KeyHash> m_flows;
+    uint64_t m_peakActive;
+    uint64_t m_exported;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,289 @@
+/*
+Per-flow fair queuing with pacing for host interfaces, modelled on Linux fq.
+
+Packets are hashed on their 5-tuple into Buckets flow queues. Flows are
+served deficit round robin with a per-flow Quantum, and a flow that becomes
+active starts on the "new" list with InitialQuantum of credit so short flows
+and ACK streams are not stuck behind bulk transfers. Each flow is limited to
+FlowLimit packets.
+
+Pacing: when MaxRate is set, every flow is released at most at that rate;
+a flow whose next departure time is in the future is parked on the
+throttled set and the queue disc arms a timer for the earliest one. A packet
+that would only leave after Horizon is dropped on enqueue, as Linux does for
+EDT timestamps beyond the horizon. TCP's own pacing rate is honoured by
+enabling TcpSocketState::EnablePacing on the sender: segments then arrive
+already spaced at the socket's rate, and the queue disc only interleaves the
+flows and applies the cap, it never re-bursts them.
+*/
+
+#ifndef FQ_PACING_QUEUE_DISC_H
+#define FQ_PACING_QUEUE_DISC_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <algorithm>
+#include <list>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace ns3
+{
+
+class FqPacingQueueDisc : public QueueDisc
+{
+  public:
+    static constexpr const char* LIMIT_EXCEEDED_DROP = "Queue disc limit exceeded";
+    static constexpr const char* FLOW_LIMIT_DROP = "Flow limit exceeded";
+    static constexpr const char* HORIZON_DROP = "Departure beyond horizon";
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::FqPacingQueueDisc")
+                .SetParent<QueueDisc>()
+                .SetGroupName("TrafficControl")
+                .AddConstructor<FqPacingQueueDisc>()
+                .AddAttribute("MaxSize",
+                              "The maximum number of packets accepted by this queue disc",
+                              QueueSizeValue(QueueSize("10000p")),
+                              MakeQueueSizeAccessor(&QueueDisc::SetMaxSize, &QueueDisc::GetMaxSize),
+                              MakeQueueSizeChecker())
+                .AddAttribute("FlowLimit",
+                              "Maximum number of packets queued per flow",
+                              UintegerValue(100),
+                              MakeUintegerAccessor(&FqPacingQueueDisc::m_flowLimit),
+                              MakeUintegerChecker<uint32_t>())
+                .AddAttribute("Buckets",
+                              "Number of flow queues",
+                              UintegerValue(1024),
+                              MakeUintegerAccessor(&FqPacingQueueDisc::m_buckets),
+                              MakeUintegerChecker<uint32_t>(1))
+                .AddAttribute("Quantum",
+                              "Credit in bytes given to a flow per round",
+                              UintegerValue(3028),
+                              MakeUintegerAccessor(&FqPacingQueueDisc::m_quantum),
+                              MakeUintegerChecker<uint32_t>(1))
+                .AddAttribute("InitialQuantum",
+                              "Credit in bytes given to a newly active flow",
+                              UintegerValue(15140),
+                              MakeUintegerAccessor(&FqPacingQueueDisc::m_initialQuantum),
+                              MakeUintegerChecker<uint32_t>())
+                .AddAttribute("MaxRate",
+                              "Per-flow pacing rate cap, 0 disables pacing",
+                              DataRateValue(DataRate(0)),
+                              MakeDataRateAccessor(&FqPacingQueueDisc::m_maxRate),
+                              MakeDataRateChecker())
+                .AddAttribute("Horizon",
+                              "Packets that would leave later than this are dropped",
+                              TimeValue(Seconds(10)),
+                              MakeTimeAccessor(&FqPacingQueueDisc::m_horizon),
+                              MakeTimeChecker());
+        return tid;
+    }
+
+    FqPacingQueueDisc()
+        : QueueDisc(QueueDiscSizePolicy::MULTIPLE_QUEUES, QueueSizeUnit::PACKETS),
+          m_flowLimit(100),
+          m_buckets(1024),
+          m_quantum(3028),
+          m_initialQuantum(15140),
+          m_perturbation(0)
+    {
+    }
+
+    uint32_t GetThrottledFlows() const
+    {
+        return m_throttled.size();
+    }
+
+  protected:
+    void DoDispose() override
+    {
+        m_wake.Cancel();
+        m_flows.clear();
+        QueueDisc::DoDispose();
+    }
+
+  private:
+    enum FlowState
+    {
+        INACTIVE,
+        NEW_FLOW,
+        OLD_FLOW,
+        THROTTLED
+    };
+
+    struct Flow
+    {
+        FlowState state;
+        int64_t credit;
+        Time timeToSend;
+        uint64_t backlog; // bytes
+    };
+
+    bool DoEnqueue(Ptr<QueueDiscItem> item) override
+    {
+        if (GetCurrentSize() + item > GetMaxSize())
+        {
+            DropBeforeEnqueue(item, LIMIT_EXCEEDED_DROP);
+            return false;
+        }
+        uint32_t index = item->Hash(m_perturbation) % m_buckets;
+        Ptr<QueueDisc::InternalQueue> queue = GetInternalQueue(index);
+        if (queue->GetNPackets() >= m_flowLimit)
+        {
+            DropBeforeEnqueue(item, FLOW_LIMIT_DROP);
+            return false;
+        }
+        Flow& flow = m_flows[index];
+        if (m_maxRate.GetBitRate() > 0)
+        {
+            Time start = std::max(flow.timeToSend, Simulator::Now());
+            if (start + m_maxRate.CalculateBytesTxTime(flow.backlog) > Simulator::Now() + m_horizon)
+            {
+                DropBeforeEnqueue(item, HORIZON_DROP);
+                return false;
+            }
+        }
+        if (!queue->Enqueue(item))
+        {
+            return false;
+        }
+        flow.backlog += item->GetSize();
+        if (flow.state == INACTIVE)
+        {
+            flow.state = NEW_FLOW;
+            flow.credit = m_initialQuantum;
+            m_newFlows.push_back(index);
+        }
+        return true;
+    }
+
+    Ptr<QueueDiscItem> DoDequeue() override
+    {
+        Time now = Simulator::Now();
+        while (!m_throttled.empty() && m_throttled.begin()->first <= now)
+        {
+            uint32_t index = m_throttled.begin()->second;
+            m_throttled.erase(m_throttled.begin());
+            m_flows[index].state = OLD_FLOW;
+            m_oldFlows.push_back(index);
+        }
+
+        while (true)
+        {
+            std::list<uint32_t>* list = !m_newFlows.empty() ? &m_newFlows : &m_oldFlows;
+            if (list->empty())
+            {
+                ArmWakeTimer();
+                return nullptr;
+            }
+            uint32_t index = list->front();
+            Flow& flow = m_flows[index];
+            if (flow.credit <= 0)
+            {
+                flow.credit += m_quantum;
+                list->pop_front();
+                flow.state = OLD_FLOW;
+                m_oldFlows.push_back(index);
+                continue;
+            }
+            Ptr<QueueDisc::InternalQueue> queue = GetInternalQueue(index);
+            if (queue->IsEmpty())
+            {
+                list->pop_front();
+                // A new flow that empties goes through the old list once, so it cannot starve others
+                if (list == &m_newFlows && !m_oldFlows.empty())
+                {
+                    flow.state = OLD_FLOW;
+                    m_oldFlows.push_back(index);
+                }
+                else
+                {
+                    flow.state = INACTIVE;
+                }
+                continue;
+            }
+            if (flow.timeToSend > now)
+            {
+                list->pop_front();
+                flow.state = THROTTLED;
+                m_throttled.insert(std::make_pair(flow.timeToSend, index));
+                continue;
+            }
+
+            Ptr<QueueDiscItem> item = queue->Dequeue();
+            flow.credit -= item->GetSize();
+            flow.backlog -= item->GetSize();
+            if (m_maxRate.GetBitRate() > 0)
+            {
+                flow.timeToSend = now + m_maxRate.CalculateBytesTxTime(item->GetSize());
+            }
+            return item;
+        }
+    }
+
+    void ArmWakeTimer()
+    {
+        if (m_throttled.empty())
+        {
+            return;
+        }
+        Time next = m_throttled.begin()->first;
+        if (m_wake.IsPending() && m_wakeTime <= next)
+        {
+            return;
+        }
+        m_wake.Cancel();
+        m_wakeTime = next;
+        m_wake = Simulator::Schedule(next - Simulator::Now(), &FqPacingQueueDisc::Run, this);
+    }
+
+    bool CheckConfig() override
+    {
+        if (GetNQueueDiscClasses() > 0 || GetNPacketFilters() > 0)
+        {
+            NS_LOG_UNCOND("FqPacingQueueDisc cannot have classes or packet filters");
+            return false;
+        }
+        while (GetNInternalQueues() < m_buckets)
+        {
+            AddInternalQueue(CreateObjectWithAttributes<DropTailQueue<QueueDiscItem>>(
+                "MaxSize",
+                QueueSizeValue(QueueSize(QueueSizeUnit::PACKETS, m_flowLimit))));
+        }
+        return GetNInternalQueues() == m_buckets;
+    }
+
+    void InitializeParams() override
+    {
+        m_perturbation = CreateObject<UniformRandomVariable>()->GetInteger();
+        m_flows.assign(m_buckets, Flow{INACTIVE, 0, Time(0), 0});
+    }
+
+    uint32_t m_flowLimit;
+    uint32_t m_buckets;
+    uint32_t m_quantum;
+    uint32_t m_initialQuantum;
+    DataRate m_maxRate;
+    Time m_horizon;
+    uint32_t m_perturbation;
+
+    std::vector<Flow> m_flows;
+    std::list<uint32_t> m_newFlows;
+    std::list<uint32_t> m_oldFlows;
+    std::set<std::pair<Time, uint32_t>> m_throttled;
+    EventId m_wake;
+    Time m_wakeTime;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(FqPacingQueueDisc);
+
+} // namespace ns3
+
+#endif
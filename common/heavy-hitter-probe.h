@@ -0,0 +1,243 @@
+/*
+Router-resident heavy-hitter telemetry in fixed memory.
+
+A HeavyHitterProbe is attached to the Enqueue trace of a queue disc. Every
+enqueued packet updates a count-min sketch of bytes per 5-tuple (Depth rows
+of Width counters) and a top-k min-heap keyed by the sketch estimate. At the
+end of every window the k heaviest contributors are written out and the
+sketch and heap are cleared. Memory is Width * Depth counters plus k heap
+entries, whatever the number of flows crossing the queue.
+
+With SetMinBacklog(n) only packets that found at least n packets already
+queued are counted, so the report ranks the flows that build up the queue
+rather than all flows that cross it.
+*/
+
+#ifndef HEAVY_HITTER_PROBE_H
+#define HEAVY_HITTER_PROBE_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+
+class HeavyHitterProbe
+{
+  public:
+    HeavyHitterProbe(std::string name, uint32_t width = 2048, uint32_t depth = 4, uint32_t k = 10)
+        : m_name(name),
+          m_width(width),
+          m_depth(depth),
+          m_k(k),
+          m_minBacklog(0),
+          m_counters(width * depth, 0),
+          m_windowBytes(0),
+          m_out(nullptr)
+    {
+        m_heap.reserve(k);
+        m_slot.reserve(2 * k);
+    }
+
+    void SetMinBacklog(uint32_t packets)
+    {
+        m_minBacklog = packets;
+    }
+
+    static void WriteHeader(std::ostream& out)
+    {
+        out << "Time(ms),Probe,Rank,Source IP,Source Port,Dest IP,Dest Port,Bytes,Share\n";
+    }
+
+    void Attach(Ptr<QueueDisc> qdisc, std::ostream& out, Time window)
+    {
+        m_qdisc = qdisc;
+        m_out = &out;
+        m_window = window;
+        qdisc->TraceConnectWithoutContext("Enqueue", MakeCallback(&HeavyHitterProbe::OnEnqueue, this));
+        Simulator::Schedule(window, &HeavyHitterProbe::Report, this);
+    }
+
+  private:
+    struct FlowKey
+    {
+        Ipv4Address source;
+        Ipv4Address destination;
+        uint16_t sourcePort;
+        uint16_t destinationPort;
+    };
+
+    struct Entry
+    {
+        uint64_t fingerprint;
+        FlowKey key;
+        uint64_t bytes;
+    };
+
+    static uint64_t Mix(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    void OnEnqueue(Ptr<const QueueDiscItem> item)
+    {
+        // The item itself is already counted in the queue disc
+        if (m_minBacklog > 0 && m_qdisc->GetNPackets() <= m_minBacklog)
+        {
+            return;
+        }
+        Ptr<const Ipv4QueueDiscItem> ipItem = DynamicCast<const Ipv4QueueDiscItem>(item);
+        if (!ipItem)
+        {
+            return;
+        }
+        const Ipv4Header& header = ipItem->GetHeader();
+        FlowKey key;
+        key.source = header.GetSource();
+        key.destination = header.GetDestination();
+        key.sourcePort = 0;
+        key.destinationPort = 0;
+        uint8_t protocol = header.GetProtocol();
+        if ((protocol == 6 || protocol == 17) && header.GetFragmentOffset() == 0 &&
+            item->GetPacket()->GetSize() >= 4)
+        {
+            uint8_t ports[4];
+            item->GetPacket()->CopyData(ports, 4);
+            key.sourcePort = (ports[0] << 8) | ports[1];
+            key.destinationPort = (ports[2] << 8) | ports[3];
+        }
+
+        uint64_t fingerprint =
+            Mix((uint64_t(key.source.Get()) << 32 | key.destination.Get()) ^
+                Mix(uint64_t(key.sourcePort) << 24 | uint64_t(key.destinationPort) << 8 | protocol));
+        uint32_t h1 = fingerprint;
+        uint32_t h2 = (fingerprint >> 32) | 1;
+        uint32_t bytes = item->GetSize();
+        uint64_t estimate = UINT64_MAX;
+        for (uint32_t row = 0; row < m_depth; row++)
+        {
+            uint64_t& counter = m_counters[row * m_width + (h1 + row * h2) % m_width];
+            counter += bytes;
+            estimate = std::min(estimate, counter);
+        }
+        m_windowBytes += bytes;
+        Offer(fingerprint, key, estimate);
+    }
+
+    // Keep the k largest estimates in a min-heap, m_slot maps a flow to its heap index
+    void Offer(uint64_t fingerprint, const FlowKey& key, uint64_t estimate)
+    {
+        std::unordered_map<uint64_t, uint32_t>::iterator it = m_slot.find(fingerprint);
+        if (it != m_slot.end())
+        {
+            m_heap[it->second].bytes = estimate;
+            SiftDown(it->second);
+            return;
+        }
+        if (m_heap.size() < m_k)
+        {
+            m_heap.push_back({fingerprint, key, estimate});
+            m_slot[fingerprint] = m_heap.size() - 1;
+            SiftUp(m_heap.size() - 1);
+            return;
+        }
+        if (estimate > m_heap[0].bytes)
+        {
+            m_slot.erase(m_heap[0].fingerprint);
+            m_heap[0] = {fingerprint, key, estimate};
+            m_slot[fingerprint] = 0;
+            SiftDown(0);
+        }
+    }
+
+    void Swap(uint32_t a, uint32_t b)
+    {
+        std::swap(m_heap[a], m_heap[b]);
+        m_slot[m_heap[a].fingerprint] = a;
+        m_slot[m_heap[b].fingerprint] = b;
+    }
+
+    void SiftUp(uint32_t i)
+    {
+        while (i > 0 && m_heap[(i - 1) / 2].bytes > m_heap[i].bytes)
+        {
+            Swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void SiftDown(uint32_t i)
+    {
+        uint32_t n = m_heap.size();
+        while (true)
+        {
+            uint32_t smallest = i;
+            uint32_t left = 2 * i + 1;
+            uint32_t right = left + 1;
+            if (left < n && m_heap[left].bytes < m_heap[smallest].bytes)
+            {
+                smallest = left;
+            }
+            if (right < n && m_heap[right].bytes < m_heap[smallest].bytes)
+            {
+                smallest = right;
+            }
+            if (smallest == i)
+            {
+                return;
+            }
+            Swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    void Report()
+    {
+        std::vector<Entry> top = m_heap;
+        std::sort(top.begin(), top.end(), [](const Entry& a, const Entry& b) { return a.bytes > b.bytes; });
+        for (uint32_t rank = 0; rank < top.size(); rank++)
+        {
+            const Entry& e = top[rank];
+            *m_out << Simulator::Now().GetMilliSeconds() << "," << m_name << "," << rank + 1 << ","
+                   << e.key.source << "," << e.key.sourcePort << "," << e.key.destination << ","
+                   << e.key.destinationPort << "," << e.bytes << ","
+                   << (m_windowBytes > 0 ? double(e.bytes) / m_windowBytes : 0.0) << "\n";
+        }
+        std::fill(m_counters.begin(), m_counters.end(), 0);
+        m_heap.clear();
+        m_slot.clear();
+        m_windowBytes = 0;
+        Simulator::Schedule(m_window, &HeavyHitterProbe::Report, this);
+    }
+
+    std::string m_name;
+    uint32_t m_width;
+    uint32_t m_depth;
+    uint32_t m_k;
+    uint32_t m_minBacklog;
+    std::vector<uint64_t> m_counters;
+    std::vector<Entry> m_heap;
+    std::unordered_map<uint64_t, uint32_t> m_slot;
+    uint64_t m_windowBytes;
+
+    Ptr<QueueDisc> m_qdisc;
+    std::ostream* m_out;
+    Time m_window;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,347 @@
+/*
+Sampled per-hop latency breakdown.
+
+FlowMonitor only reports the end-to-end delay of a flow. HopLatencyProbe
+tags 1 in SampleEvery packets a host sends (its Ipv4L3Protocol
+SendOutgoing trace) with the send time and the flow class of the packet.
+Each queue disc added with AddQueueDisc(qdisc, name) writes the enqueue and
+dequeue time of the tagged packets it forwards into the tag (MaxHops queue
+discs per packet). When the packet is delivered to the receiving host
+(LocalDeliver), the probe records for its class:
+    <name>   sojourn in that queue disc, dequeue - enqueue
+    wire     end-to-end delay minus the queue disc sojourns, i.e.
+             serialization, propagation and the device transmit queues
+    total    end-to-end delay from the IP layer of the sender
+Classes are added with AddClass(name, source, destination), where
+Ipv4Address::GetAny() matches any address; the first matching class is
+used and packets of no class are not sampled. Without classes every packet
+is in class "all". Sampling is a per-class packet counter, so the overhead is
+one tag per SampleEvery packets and the samples are kept in memory only for
+the delivered tagged packets.
+
+Write() writes the per class and hop distribution (count, mean, p50, p95,
+p99, max in us). SetSampleOutput() also writes one row per delivered tagged
+packet.
+*/
+
+#ifndef HOP_LATENCY_H
+#define HOP_LATENCY_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+class HopLatencyTag : public Tag
+{
+  public:
+    static const uint8_t MaxHops = 4;
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid = TypeId("ns3::HopLatencyTag")
+                                .SetParent<Tag>()
+                                .SetGroupName("Network")
+                                .AddConstructor<HopLatencyTag>();
+        return tid;
+    }
+
+    TypeId GetInstanceTypeId() const override
+    {
+        return GetTypeId();
+    }
+
+    // Fixed size, so ReplacePacketTag() can rewrite the tag in place as hops are added
+    uint32_t GetSerializedSize() const override
+    {
+        return 10 + MaxHops * 17;
+    }
+
+    void Serialize(TagBuffer i) const override
+    {
+        i.WriteU8(flowClass);
+        i.WriteU8(hops);
+        i.WriteU64(sent);
+        for (uint8_t h = 0; h < MaxHops; h++)
+        {
+            i.WriteU8(hop[h]);
+            i.WriteU64(enqueue[h]);
+            i.WriteU64(dequeue[h]);
+        }
+    }
+
+    void Deserialize(TagBuffer i) override
+    {
+        flowClass = i.ReadU8();
+        hops = i.ReadU8();
+        sent = i.ReadU64();
+        for (uint8_t h = 0; h < MaxHops; h++)
+        {
+            hop[h] = i.ReadU8();
+            enqueue[h] = i.ReadU64();
+            dequeue[h] = i.ReadU64();
+        }
+    }
+
+    void Print(std::ostream& os) const override
+    {
+        os << "class=" << (uint32_t)flowClass << " hops=" << (uint32_t)hops << " sent=" << sent;
+    }
+
+    uint8_t flowClass = 0;
+    uint8_t hops = 0;
+    uint64_t sent = 0; // ns
+    uint8_t hop[MaxHops] = {};
+    uint64_t enqueue[MaxHops] = {};
+    uint64_t dequeue[MaxHops] = {}; // 0 until dequeued
+};
+
+NS_OBJECT_ENSURE_REGISTERED(HopLatencyTag);
+
+class HopLatencyProbe
+{
+  public:
+    HopLatencyProbe(uint32_t sampleEvery = 100)
+        : m_sampleEvery(std::max<uint32_t>(sampleEvery, 1)),
+          m_sampleOut(nullptr),
+          m_tagged(0),
+          m_delivered(0)
+    {
+    }
+
+    void AddClass(std::string name, Ipv4Address source, Ipv4Address destination)
+    {
+        Match match;
+        match.source = source;
+        match.destination = destination;
+        match.flowClass = ClassIndex(name);
+        m_matches.push_back(match);
+    }
+
+    // Call before Install() so the sample rows have a column per queue disc
+    void AddQueueDisc(Ptr<QueueDisc> qdisc, std::string name)
+    {
+        NS_ABORT_MSG_IF(m_hopNames.size() == 255, "Too many queue discs");
+        uint8_t hop = m_hopNames.size();
+        m_hopNames.push_back(name);
+        qdisc->TraceConnectWithoutContext("Enqueue", MakeBoundCallback(&HopLatencyProbe::OnEnqueue, hop));
+        qdisc->TraceConnectWithoutContext("Dequeue", MakeBoundCallback(&HopLatencyProbe::OnDequeue, hop));
+    }
+
+    // Hosts both send tagged packets and collect them
+    void Install(NodeContainer hosts)
+    {
+        if (m_classNames.empty())
+        {
+            AddClass("all", Ipv4Address::GetAny(), Ipv4Address::GetAny());
+        }
+        m_counters.assign(m_classNames.size(), 0);
+        m_samples.resize(m_classNames.size(), std::vector<std::vector<double>>(m_hopNames.size() + 2));
+        for (uint32_t i = 0; i < hosts.GetN(); i++)
+        {
+            Ptr<Ipv4L3Protocol> ipv4 = hosts.Get(i)->GetObject<Ipv4L3Protocol>();
+            NS_ABORT_MSG_IF(!ipv4, "Install the internet stack before the latency probe");
+            ipv4->TraceConnectWithoutContext("SendOutgoing", MakeCallback(&HopLatencyProbe::OnSend, this));
+            ipv4->TraceConnectWithoutContext("LocalDeliver", MakeCallback(&HopLatencyProbe::OnDeliver, this));
+        }
+    }
+
+    void SetSampleOutput(std::ostream* out)
+    {
+        m_sampleOut = out;
+        *out << "Time(s),Class";
+        for (const std::string& name : m_hopNames)
+        {
+            *out << "," << name << "(us)";
+        }
+        *out << ",wire(us),total(us)\n";
+    }
+
+    static void WriteHeader(std::ostream& out)
+    {
+        out << "Class,Hop,Samples,Mean(us),P50(us),P95(us),P99(us),Max(us)\n";
+    }
+
+    void Write(std::ostream& out)
+    {
+        for (uint32_t c = 0; c < m_samples.size(); c++)
+        {
+            for (uint32_t h = 0; h < m_samples[c].size(); h++)
+            {
+                std::vector<double>& v = m_samples[c][h];
+                if (v.empty())
+                {
+                    continue;
+                }
+                std::sort(v.begin(), v.end());
+                double sum = 0;
+                for (double x : v)
+                {
+                    sum += x;
+                }
+                out << m_classNames[c] << "," << HopName(h) << "," << v.size() << "," << sum / v.size() << ","
+                    << Percentile(v, 50) << "," << Percentile(v, 95) << "," << Percentile(v, 99) << "," << v.back()
+                    << "\n";
+            }
+        }
+    }
+
+    uint64_t GetTagged() const
+    {
+        return m_tagged;
+    }
+
+    uint64_t GetDelivered() const
+    {
+        return m_delivered;
+    }
+
+  private:
+    struct Match
+    {
+        Ipv4Address source;
+        Ipv4Address destination;
+        uint8_t flowClass;
+    };
+
+    uint8_t ClassIndex(std::string name)
+    {
+        for (uint32_t c = 0; c < m_classNames.size(); c++)
+        {
+            if (m_classNames[c] == name)
+            {
+                return c;
+            }
+        }
+        NS_ABORT_MSG_IF(m_classNames.size() == 255, "Too many classes");
+        m_classNames.push_back(name);
+        return m_classNames.size() - 1;
+    }
+
+    std::string HopName(uint32_t h) const
+    {
+        if (h < m_hopNames.size())
+        {
+            return m_hopNames[h];
+        }
+        return h == m_hopNames.size() ? "wire" : "total";
+    }
+
+    // Nearest-rank percentile of sorted values
+    static double Percentile(const std::vector<double>& sorted, double p)
+    {
+        size_t rank = (size_t)std::ceil(p / 100 * sorted.size());
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    }
+
+    void OnSend(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface)
+    {
+        for (const Match& m : m_matches)
+        {
+            if ((m.source.IsAny() || m.source == header.GetSource()) &&
+                (m.destination.IsAny() || m.destination == header.GetDestination()))
+            {
+                HopLatencyTag tag;
+                if (++m_counters[m.flowClass] % m_sampleEvery != 0 || packet->PeekPacketTag(tag))
+                {
+                    return;
+                }
+                tag.flowClass = m.flowClass;
+                tag.sent = Simulator::Now().GetNanoSeconds();
+                packet->AddPacketTag(tag);
+                m_tagged++;
+                return;
+            }
+        }
+    }
+
+    static void OnEnqueue(uint8_t hop, Ptr<const QueueDiscItem> item)
+    {
+        Ptr<Packet> packet = item->GetPacket();
+        HopLatencyTag tag;
+        if (!packet->PeekPacketTag(tag) || tag.hops == HopLatencyTag::MaxHops)
+        {
+            return;
+        }
+        tag.hop[tag.hops] = hop;
+        tag.enqueue[tag.hops] = Simulator::Now().GetNanoSeconds();
+        tag.dequeue[tag.hops] = 0;
+        tag.hops++;
+        packet->ReplacePacketTag(tag);
+    }
+
+    static void OnDequeue(uint8_t hop, Ptr<const QueueDiscItem> item)
+    {
+        Ptr<Packet> packet = item->GetPacket();
+        HopLatencyTag tag;
+        if (!packet->PeekPacketTag(tag) || tag.hops == 0 || tag.hop[tag.hops - 1] != hop)
+        {
+            return;
+        }
+        tag.dequeue[tag.hops - 1] = Simulator::Now().GetNanoSeconds();
+        packet->ReplacePacketTag(tag);
+    }
+
+    void OnDeliver(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface)
+    {
+        HopLatencyTag tag;
+        if (!packet->PeekPacketTag(tag) || tag.flowClass >= m_samples.size())
+        {
+            return;
+        }
+        m_delivered++;
+        std::vector<std::vector<double>>& samples = m_samples[tag.flowClass];
+        std::vector<double> sojourn(m_hopNames.size(), -1);
+        double total = (Simulator::Now().GetNanoSeconds() - (int64_t)tag.sent) / 1e3;
+        double queued = 0;
+        for (uint8_t h = 0; h < tag.hops; h++)
+        {
+            if (tag.dequeue[h] == 0 || tag.hop[h] >= m_hopNames.size())
+            {
+                continue;
+            }
+            double us = (tag.dequeue[h] - tag.enqueue[h]) / 1e3;
+            sojourn[tag.hop[h]] = us;
+            samples[tag.hop[h]].push_back(us);
+            queued += us;
+        }
+        samples[m_hopNames.size()].push_back(total - queued);
+        samples[m_hopNames.size() + 1].push_back(total);
+        if (m_sampleOut)
+        {
+            *m_sampleOut << Simulator::Now().GetSeconds() << "," << m_classNames[tag.flowClass];
+            for (double us : sojourn)
+            {
+                *m_sampleOut << ",";
+                if (us >= 0)
+                {
+                    *m_sampleOut << us;
+                }
+            }
+            *m_sampleOut << "," << total - queued << "," << total << "\n";
+        }
+    }
+
+    uint32_t m_sampleEvery;
+    std::vector<std::string> m_classNames;
+    std::vector<std::string> m_hopNames;
+    std::vector<Match> m_matches;
+    std::vector<uint64_t> m_counters;
+    std::vector<std::vector<std::vector<double>>> m_samples; // class, hop (+ wire, total), us
+    std::ostream* m_sampleOut;
+    uint64_t m_tagged;
+    uint64_t m_delivered;
+};
+
+} // namespace ns3
+
+#endif
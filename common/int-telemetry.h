@@ -0,0 +1,428 @@
+/*
+In-band network telemetry (INT) for point-to-point fabrics.
+
+IntHelper::InstallHosts(hosts) tags 1 in SampleEvery packets the hosts send
+(Ipv4L3Protocol SendOutgoing) with an empty IntTag. Every device of a node
+added with InstallSwitch(node) appends a hop record to the tag of the
+packets it starts to transmit (PhyTxBegin), as an INT switch does at egress:
+    node          ID of the switch
+    queue         bytes in the root queue disc and the device transmit queue
+    egress        time the packet starts to leave the port
+    txBytes       bytes the port has transmitted so far
+    rate          line rate of the port
+    utilization   port busy fraction, an EWMA over UtilizationWindow as in
+                  HPCC: u = u * (1 - dt / T) + serialization / T
+At most MaxHops hops are recorded.
+
+Receivers see the tag when the packet is delivered (LocalDeliver). The
+receiver callback gets the data flow and the tag. The receiver also keeps
+the last tag of each flow and echoes it in an IntEchoTag on the next packet
+it sends back on that flow (the ACK for TCP). The sender callback gets the
+echo with the data flow it describes, so a sender learns the state of every
+queue on its path one RTT later, per sampled packet. SetLog() writes one row
+per hop of every tag delivered and every echo received.
+*/
+
+#ifndef INT_TELEMETRY_H
+#define INT_TELEMETRY_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <tuple>
+#include <vector>
+
+namespace ns3
+{
+
+class IntTag : public Tag
+{
+  public:
+    static const uint8_t MaxHops = 5;
+
+    struct Hop
+    {
+        uint32_t node;
+        uint32_t queue; // bytes
+        uint64_t egress; // ns
+        uint64_t txBytes;
+        uint64_t rate; // bps
+        uint32_t utilization; // parts per million
+    };
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::IntTag").SetParent<Tag>().SetGroupName("Network").AddConstructor<IntTag>();
+        return tid;
+    }
+
+    TypeId GetInstanceTypeId() const override
+    {
+        return GetTypeId();
+    }
+
+    // Fixed size, so ReplacePacketTag() can rewrite the tag in place as hops are added
+    uint32_t GetSerializedSize() const override
+    {
+        return 1 + MaxHops * 36;
+    }
+
+    void Serialize(TagBuffer i) const override
+    {
+        i.WriteU8(hops);
+        for (uint8_t h = 0; h < MaxHops; h++)
+        {
+            i.WriteU32(hop[h].node);
+            i.WriteU32(hop[h].queue);
+            i.WriteU64(hop[h].egress);
+            i.WriteU64(hop[h].txBytes);
+            i.WriteU64(hop[h].rate);
+            i.WriteU32(hop[h].utilization);
+        }
+    }
+
+    void Deserialize(TagBuffer i) override
+    {
+        hops = i.ReadU8();
+        for (uint8_t h = 0; h < MaxHops; h++)
+        {
+            hop[h].node = i.ReadU32();
+            hop[h].queue = i.ReadU32();
+            hop[h].egress = i.ReadU64();
+            hop[h].txBytes = i.ReadU64();
+            hop[h].rate = i.ReadU64();
+            hop[h].utilization = i.ReadU32();
+        }
+    }
+
+    void Print(std::ostream& os) const override
+    {
+        os << "hops=" << (uint32_t)hops;
+        for (uint8_t h = 0; h < hops; h++)
+        {
+            os << " [node=" << hop[h].node << " queue=" << hop[h].queue << "B u=" << hop[h].utilization * 1e-6 << "]";
+        }
+    }
+
+    // Largest queue on the path, in bytes
+    uint32_t GetMaxQueue() const
+    {
+        uint32_t queue = 0;
+        for (uint8_t h = 0; h < hops; h++)
+        {
+            queue = std::max(queue, hop[h].queue);
+        }
+        return queue;
+    }
+
+    uint8_t hops = 0;
+    Hop hop[MaxHops] = {};
+};
+
+NS_OBJECT_ENSURE_REGISTERED(IntTag);
+
+// The tag of a data packet carried back to its sender
+class IntEchoTag : public IntTag
+{
+  public:
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::IntEchoTag").SetParent<IntTag>().SetGroupName("Network").AddConstructor<IntEchoTag>();
+        return tid;
+    }
+
+    TypeId GetInstanceTypeId() const override
+    {
+        return GetTypeId();
+    }
+};
+
+NS_OBJECT_ENSURE_REGISTERED(IntEchoTag);
+
+// One direction of a transport flow
+struct IntFlow
+{
+    Ipv4Address source;
+    Ipv4Address destination;
+    uint16_t sourcePort;
+    uint16_t destinationPort;
+
+    IntFlow Reverse() const
+    {
+        IntFlow r;
+        r.source = destination;
+        r.destination = source;
+        r.sourcePort = destinationPort;
+        r.destinationPort = sourcePort;
+        return r;
+    }
+
+    bool operator<(const IntFlow& other) const
+    {
+        return std::make_tuple(source.Get(), destination.Get(), sourcePort, destinationPort) <
+               std::make_tuple(other.source.Get(), other.destination.Get(), other.sourcePort, other.destinationPort);
+    }
+};
+
+class IntHelper
+{
+  public:
+    IntHelper(uint32_t sampleEvery = 1)
+        : m_sampleEvery(std::max<uint32_t>(sampleEvery, 1)),
+          m_counter(0),
+          m_window(MicroSeconds(100)),
+          m_sent(0),
+          m_delivered(0),
+          m_echoes(0),
+          m_log(nullptr)
+    {
+    }
+
+    void SetUtilizationWindow(Time window)
+    {
+        m_window = window;
+    }
+
+    void SetReceiverCallback(Callback<void, const IntFlow&, const IntTag&> callback)
+    {
+        m_receiverCallback = callback;
+    }
+
+    void SetSenderCallback(Callback<void, const IntFlow&, const IntTag&> callback)
+    {
+        m_senderCallback = callback;
+    }
+
+    void SetLog(std::ostream* log)
+    {
+        m_log = log;
+    }
+
+    static void WriteLogHeader(std::ostream& out)
+    {
+        out << "Time(s),Side,Source IP,Source Port,Dest IP,Dest Port,Hop,Node,Queue(B),Egress(s),TxBytes,Rate(bps),"
+               "Utilization\n";
+    }
+
+    // Every device of the node fills in a hop record
+    void InstallSwitch(Ptr<Node> node)
+    {
+        for (uint32_t d = 0; d < node->GetNDevices(); d++)
+        {
+            Ptr<PointToPointNetDevice> device = DynamicCast<PointToPointNetDevice>(node->GetDevice(d));
+            if (!device)
+            {
+                continue;
+            }
+            Port port;
+            port.device = PeekPointer(device);
+            DataRateValue rate;
+            device->GetAttribute("DataRate", rate);
+            port.rate = rate.Get().GetBitRate();
+            port.txBytes = 0;
+            port.lastTx = 0;
+            port.utilization = 0;
+            m_ports.push_back(port);
+            device->TraceConnectWithoutContext(
+                "PhyTxBegin",
+                MakeBoundCallback(&IntHelper::OnPhyTxBegin, this, (uint32_t)m_ports.size() - 1));
+        }
+    }
+
+    void InstallSwitches(NodeContainer nodes)
+    {
+        for (uint32_t i = 0; i < nodes.GetN(); i++)
+        {
+            InstallSwitch(nodes.Get(i));
+        }
+    }
+
+    // Hosts send tagged packets, receive them and echo their tags
+    void InstallHosts(NodeContainer hosts)
+    {
+        for (uint32_t i = 0; i < hosts.GetN(); i++)
+        {
+            Ptr<Ipv4L3Protocol> ipv4 = hosts.Get(i)->GetObject<Ipv4L3Protocol>();
+            NS_ABORT_MSG_IF(!ipv4, "Install the internet stack before INT");
+            ipv4->TraceConnectWithoutContext("SendOutgoing", MakeCallback(&IntHelper::OnSend, this));
+            ipv4->TraceConnectWithoutContext("LocalDeliver", MakeCallback(&IntHelper::OnDeliver, this));
+        }
+    }
+
+    uint64_t GetSent() const
+    {
+        return m_sent;
+    }
+
+    uint64_t GetDelivered() const
+    {
+        return m_delivered;
+    }
+
+    uint64_t GetEchoes() const
+    {
+        return m_echoes;
+    }
+
+  private:
+    struct Port
+    {
+        PointToPointNetDevice* device;
+        uint64_t rate;
+        uint64_t txBytes;
+        int64_t lastTx; // ns
+        double utilization;
+    };
+
+    static IntFlow MakeFlow(const Ipv4Header& header, Ptr<const Packet> packet)
+    {
+        IntFlow flow;
+        flow.source = header.GetSource();
+        flow.destination = header.GetDestination();
+        flow.sourcePort = 0;
+        flow.destinationPort = 0;
+        uint8_t protocol = header.GetProtocol();
+        if ((protocol == 6 || protocol == 17) && packet->GetSize() >= 4)
+        {
+            uint8_t buf[4];
+            packet->CopyData(buf, 4);
+            flow.sourcePort = (uint16_t)buf[0] << 8 | buf[1];
+            flow.destinationPort = (uint16_t)buf[2] << 8 | buf[3];
+        }
+        return flow;
+    }
+
+    static void OnPhyTxBegin(IntHelper* helper, uint32_t index, Ptr<const Packet> packet)
+    {
+        Port& port = helper->m_ports[index];
+        int64_t now = Simulator::Now().GetNanoSeconds();
+        // Busy fraction over the window, updated with every transmission
+        double window = helper->m_window.GetNanoSeconds();
+        double serialization = packet->GetSize() * 8e9 / port.rate;
+        double idle = std::min<double>(now - port.lastTx, window);
+        port.utilization = port.utilization * (1 - idle / window) + serialization / window;
+        port.lastTx = now;
+        port.txBytes += packet->GetSize();
+
+        IntTag tag;
+        if (!packet->PeekPacketTag(tag) || tag.hops == IntTag::MaxHops)
+        {
+            return;
+        }
+        uint64_t queue = 0;
+        Ptr<TrafficControlLayer> tc = port.device->GetNode()->GetObject<TrafficControlLayer>();
+        Ptr<QueueDisc> qdisc = tc ? tc->GetRootQueueDiscOnDevice(port.device) : nullptr;
+        if (qdisc)
+        {
+            queue += qdisc->GetNBytes();
+        }
+        queue += port.device->GetQueue()->GetNBytes();
+        IntTag::Hop& hop = tag.hop[tag.hops++];
+        hop.node = port.device->GetNode()->GetId();
+        hop.queue = std::min<uint64_t>(queue, UINT32_MAX);
+        hop.egress = now;
+        hop.txBytes = port.txBytes;
+        hop.rate = port.rate;
+        hop.utilization = std::min(port.utilization, 1.0) * 1e6;
+        // The device transmits this packet object, the channel copies it after PhyTxBegin
+        ConstCast<Packet>(packet)->ReplacePacketTag(tag);
+    }
+
+    void OnSend(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface)
+    {
+        IntTag tag;
+        if (++m_counter % m_sampleEvery == 0 && !packet->PeekPacketTag(tag))
+        {
+            packet->AddPacketTag(tag);
+            m_sent++;
+        }
+        // The packet carries the last telemetry of the flow it answers
+        if (m_echo.empty())
+        {
+            return;
+        }
+        IntFlow flow = MakeFlow(header, packet);
+        std::map<IntFlow, IntTag>::iterator it = m_echo.find(flow.Reverse());
+        IntEchoTag echo;
+        if (it != m_echo.end() && !packet->PeekPacketTag(echo))
+        {
+            echo.hops = it->second.hops;
+            std::copy(it->second.hop, it->second.hop + IntTag::MaxHops, echo.hop);
+            packet->AddPacketTag(echo);
+            m_echo.erase(it);
+        }
+    }
+
+    void OnDeliver(const Ipv4Header& header, Ptr<const Packet> packet, uint32_t interface)
+    {
+        IntTag tag;
+        IntEchoTag echo;
+        bool hasTag = packet->PeekPacketTag(tag);
+        bool hasEcho = packet->PeekPacketTag(echo);
+        if (!hasTag && !hasEcho)
+        {
+            return;
+        }
+        IntFlow flow = MakeFlow(header, packet);
+        if (hasTag && tag.hops > 0)
+        {
+            m_delivered++;
+            m_echo[flow] = tag;
+            Log("receiver", flow, tag);
+            if (!m_receiverCallback.IsNull())
+            {
+                m_receiverCallback(flow, tag);
+            }
+        }
+        if (hasEcho)
+        {
+            // The echo describes the data direction, the reverse of this packet
+            m_echoes++;
+            Log("sender", flow.Reverse(), echo);
+            if (!m_senderCallback.IsNull())
+            {
+                m_senderCallback(flow.Reverse(), echo);
+            }
+        }
+    }
+
+    void Log(const char* side, const IntFlow& flow, const IntTag& tag)
+    {
+        if (!m_log)
+        {
+            return;
+        }
+        for (uint8_t h = 0; h < tag.hops; h++)
+        {
+            const IntTag::Hop& hop = tag.hop[h];
+            *m_log << Simulator::Now().GetSeconds() << "," << side << "," << flow.source << "," << flow.sourcePort << ","
+                   << flow.destination << "," << flow.destinationPort << "," << (uint32_t)h << "," << hop.node << ","
+                   << hop.queue << "," << hop.egress * 1e-9 << "," << hop.txBytes << "," << hop.rate << ","
+                   << hop.utilization * 1e-6 << "\n";
+        }
+    }
+
+    uint32_t m_sampleEvery;
+    uint64_t m_counter;
+    Time m_window;
+    std::vector<Port> m_ports;
+    std::map<IntFlow, IntTag> m_echo;
+    Callback<void, const IntFlow&, const IntTag&> m_receiverCallback;
+    Callback<void, const IntFlow&, const IntTag&> m_senderCallback;
+    uint64_t m_sent;
+    uint64_t m_delivered;
+    uint64_t m_echoes;
+    std::ostream* m_log;
+};
+
+} // namespace ns3
+
+#endif
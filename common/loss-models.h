@@ -0,0 +1,299 @@
+/*
+Cheap receive-path loss models with reproducible drop sequences.
+
+RateErrorModel draws a uniform random number for every packet. The models
+here draw one number per loss (or per state change) instead: the number of
+packets until the next loss is geometric for independent losses, so it is
+precomputed with a single draw and every packet only costs an integer
+compare against the next-loss index.
+
+DropScheduleErrorModel drops packet i (counting from 1, over the packets
+seen by this model) when i is in its schedule. The schedule is either
+generated on the fly at ErrorRate with geometric skips, or replayed from a
+list of indices (SetSchedule / LoadSchedule). With SetRecord the dropped
+indices are written out one per line, in the format LoadSchedule reads, so
+a run can be replayed exactly even if the RNG run or seed changes.
+
+GilbertElliottErrorModel is the two-state bursty channel: a Good and a Bad
+state with loss probabilities LossGood and LossBad, left with probabilities
+PGoodBad and PBadGood per packet. State sojourns and losses within a state
+are both drawn as geometric skips.
+
+Use one model instance per receiver: a shared instance interleaves the
+packet counters of all the devices it is attached to.
+*/
+
+#ifndef LOSS_MODELS_H
+#define LOSS_MODELS_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+// Packets before the next event of probability p per packet (geometric, support 0, 1, ...)
+inline uint64_t
+GeometricSkip(Ptr<UniformRandomVariable> uniform, double p)
+{
+    if (p <= 0.0)
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    if (p >= 1.0)
+    {
+        return 0;
+    }
+    double u = uniform->GetValue(0.0, 1.0);
+    while (u <= 0.0)
+    {
+        u = uniform->GetValue(0.0, 1.0);
+    }
+    double skip = std::floor(std::log(u) / std::log1p(-p));
+    return skip >= double(std::numeric_limits<uint64_t>::max()) ? std::numeric_limits<uint64_t>::max()
+                                                                  : uint64_t(skip);
+}
+
+class DropScheduleErrorModel : public ErrorModel
+{
+  public:
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::DropScheduleErrorModel")
+                .SetParent<ErrorModel>()
+                .SetGroupName("Network")
+                .AddConstructor<DropScheduleErrorModel>()
+                .AddAttribute("ErrorRate",
+                              "Independent loss probability per packet, used without a schedule",
+                              DoubleValue(0.0),
+                              MakeDoubleAccessor(&DropScheduleErrorModel::m_rate),
+                              MakeDoubleChecker<double>(0.0, 1.0));
+        return tid;
+    }
+
+    DropScheduleErrorModel()
+        : m_rate(0.0),
+          m_replay(false),
+          m_position(0),
+          m_index(0),
+          m_next(0),
+          m_record(nullptr)
+    {
+        m_uniform = CreateObject<UniformRandomVariable>();
+    }
+
+    // Replay these packet indices (1-based, increasing) instead of drawing losses
+    void SetSchedule(const std::vector<uint64_t>& schedule)
+    {
+        for (size_t i = 0; i < schedule.size(); i++)
+        {
+            if (schedule[i] == 0 || (i > 0 && schedule[i] <= schedule[i - 1]))
+            {
+                NS_FATAL_ERROR("Drop schedule index " << schedule[i] << " at position " << i + 1
+                                                      << " is not 1-based and increasing");
+            }
+        }
+        m_schedule = schedule;
+        m_replay = true;
+        Reset();
+    }
+
+    void LoadSchedule(std::string path)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            NS_FATAL_ERROR("Cannot open drop schedule " << path);
+        }
+        std::vector<uint64_t> schedule;
+        uint64_t index;
+        while (in >> index)
+        {
+            schedule.push_back(index);
+        }
+        SetSchedule(schedule);
+    }
+
+    void SetRecord(std::ostream* record)
+    {
+        m_record = record;
+    }
+
+    int64_t AssignStreams(int64_t stream)
+    {
+        m_uniform->SetStream(stream);
+        return 1;
+    }
+
+  private:
+    bool DoCorrupt(Ptr<Packet> p) override
+    {
+        if (m_next == 0)
+        {
+            Advance();
+        }
+        if (++m_index != m_next)
+        {
+            return false;
+        }
+        if (m_record)
+        {
+            *m_record << m_index << "\n";
+        }
+        Advance();
+        return true;
+    }
+
+    void Advance()
+    {
+        if (m_replay)
+        {
+            m_next = m_position < m_schedule.size() ? m_schedule[m_position++] : 0;
+            return;
+        }
+        uint64_t skip = GeometricSkip(m_uniform, m_rate);
+        m_next = skip == std::numeric_limits<uint64_t>::max() ? 0 : m_index + skip + 1;
+    }
+
+    void DoReset() override
+    {
+        m_position = 0;
+        m_index = 0;
+        m_next = 0;
+    }
+
+    double m_rate;
+    bool m_replay;
+    std::vector<uint64_t> m_schedule;
+    size_t m_position;
+    uint64_t m_index;
+    uint64_t m_next; // index of the next packet to drop, 0 when there is none
+    std::ostream* m_record;
+    Ptr<UniformRandomVariable> m_uniform;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(DropScheduleErrorModel);
+
+class GilbertElliottErrorModel : public ErrorModel
+{
+  public:
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::GilbertElliottErrorModel")
+                .SetParent<ErrorModel>()
+                .SetGroupName("Network")
+                .AddConstructor<GilbertElliottErrorModel>()
+                .AddAttribute("PGoodBad",
+                              "Probability per packet of moving from Good to Bad",
+                              DoubleValue(0.0001),
+                              MakeDoubleAccessor(&GilbertElliottErrorModel::m_pGoodBad),
+                              MakeDoubleChecker<double>(0.0, 1.0))
+                .AddAttribute("PBadGood",
+                              "Probability per packet of moving from Bad to Good",
+                              DoubleValue(0.5),
+                              MakeDoubleAccessor(&GilbertElliottErrorModel::m_pBadGood),
+                              MakeDoubleChecker<double>(0.0, 1.0))
+                .AddAttribute("LossGood",
+                              "Loss probability in the Good state",
+                              DoubleValue(0.0),
+                              MakeDoubleAccessor(&GilbertElliottErrorModel::m_lossGood),
+                              MakeDoubleChecker<double>(0.0, 1.0))
+                .AddAttribute("LossBad",
+                              "Loss probability in the Bad state",
+                              DoubleValue(1.0),
+                              MakeDoubleAccessor(&GilbertElliottErrorModel::m_lossBad),
+                              MakeDoubleChecker<double>(0.0, 1.0));
+        return tid;
+    }
+
+    GilbertElliottErrorModel()
+        : m_pGoodBad(0.0001),
+          m_pBadGood(0.5),
+          m_lossGood(0.0),
+          m_lossBad(1.0),
+          m_bad(true),
+          m_stateLeft(0),
+          m_lossSkip(0),
+          m_record(nullptr),
+          m_index(0)
+    {
+        m_uniform = CreateObject<UniformRandomVariable>();
+    }
+
+    void SetRecord(std::ostream* record)
+    {
+        m_record = record;
+    }
+
+    int64_t AssignStreams(int64_t stream)
+    {
+        m_uniform->SetStream(stream);
+        return 1;
+    }
+
+  private:
+    bool DoCorrupt(Ptr<Packet> p) override
+    {
+        m_index++;
+        if (m_stateLeft == 0)
+        {
+            // Sojourn is at least one packet; losses inside a state are memoryless, so redraw them
+            m_bad = !m_bad;
+            uint64_t skip = GeometricSkip(m_uniform, m_bad ? m_pBadGood : m_pGoodBad);
+            m_stateLeft = skip == std::numeric_limits<uint64_t>::max() ? skip : skip + 1;
+            m_lossSkip = GeometricSkip(m_uniform, m_bad ? m_lossBad : m_lossGood);
+        }
+        if (m_stateLeft != std::numeric_limits<uint64_t>::max())
+        {
+            m_stateLeft--;
+        }
+        if (m_lossSkip > 0)
+        {
+            if (m_lossSkip != std::numeric_limits<uint64_t>::max())
+            {
+                m_lossSkip--;
+            }
+            return false;
+        }
+        m_lossSkip = GeometricSkip(m_uniform, m_bad ? m_lossBad : m_lossGood);
+        if (m_record)
+        {
+            *m_record << m_index << "\n";
+        }
+        return true;
+    }
+
+    void DoReset() override
+    {
+        m_bad = true;
+        m_stateLeft = 0;
+        m_lossSkip = 0;
+        m_index = 0;
+    }
+
+    double m_pGoodBad;
+    double m_pBadGood;
+    double m_lossGood;
+    double m_lossBad;
+    bool m_bad;
+    uint64_t m_stateLeft; // packets left in the current state
+    uint64_t m_lossSkip;  // packets before the next loss in the current state
+    std::ostream* m_record;
+    uint64_t m_index;
+    Ptr<UniformRandomVariable> m_uniform;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(GilbertElliottErrorModel);
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,355 @@
+/*
+Periodic census of where the memory of a run is.
+
+Every Interval, MemoryCensus walks the node list and writes one row per
+category with its live instance count and the bytes it holds:
+    rss                     resident set of the process (/proc/self/statm)
+    events                  events pending in the scheduler
+    nodes                   nodes
+    device:<type>           net devices, bytes in their transmit queues
+    qdisc:<type>            root queue discs, bytes queued
+    app:<type>              applications (instances only)
+    socket:<type>           TCP sockets, bytes in their send and receive buffers
+    tcp-tx-max, tcp-rx-max  the fullest send and receive buffer of one socket
+    flowmon                 FlowMonitor flows, bytes estimated from the flow
+                            stats and their histogram bins
+    <gauge>                 AddGauge(name, instances, bytesPerInstance)
+The walk costs one pass over the devices, queue discs and sockets per
+sample, so an Interval of a second or more is cheap enough to leave on.
+Socket and queue bytes are payload held, not the allocator footprint; the
+rss row gives the total.
+
+Pending events are only known with the CountingScheduler installed, which
+wraps the default MapScheduler and counts inserts and removals.
+EnableEventCounting() installs it; the events already scheduled are moved
+into it and counted. Call it again after Simulator::Destroy() for the next
+run. It also records the peak between two samples.
+
+WritePeaks() writes the peak instances and bytes of every category and when
+the peak bytes were seen.
+*/
+
+#ifndef MEMORY_CENSUS_H
+#define MEMORY_CENSUS_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/flow-monitor-module.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace ns3
+{
+
+class CountingScheduler : public Scheduler
+{
+  public:
+    static TypeId GetTypeId()
+    {
+        static TypeId tid = TypeId("ns3::CountingScheduler")
+                                .SetParent<Scheduler>()
+                                .SetGroupName("Core")
+                                .AddConstructor<CountingScheduler>();
+        return tid;
+    }
+
+    CountingScheduler()
+    {
+        ObjectFactory factory("ns3::MapScheduler");
+        m_inner = factory.Create<Scheduler>();
+    }
+
+    void Insert(const Event& ev) override
+    {
+        m_inner->Insert(ev);
+        Pending()++;
+        Peak() = std::max(Peak(), Pending());
+    }
+
+    bool IsEmpty() const override
+    {
+        return m_inner->IsEmpty();
+    }
+
+    Event PeekNext() const override
+    {
+        return m_inner->PeekNext();
+    }
+
+    Event RemoveNext() override
+    {
+        Pending()--;
+        return m_inner->RemoveNext();
+    }
+
+    void Remove(const Event& ev) override
+    {
+        Pending()--;
+        m_inner->Remove(ev);
+    }
+
+    // Shared by all instances; the simulator has one scheduler at a time
+    static uint64_t& Pending()
+    {
+        static uint64_t pending = 0;
+        return pending;
+    }
+
+    static uint64_t& Peak()
+    {
+        static uint64_t peak = 0;
+        return peak;
+    }
+
+  private:
+    Ptr<Scheduler> m_inner;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(CountingScheduler);
+
+class MemoryCensus
+{
+  public:
+    MemoryCensus()
+        : m_interval(Seconds(1)),
+          m_out(nullptr)
+    {
+    }
+
+    static void EnableEventCounting()
+    {
+        CountingScheduler::Pending() = 0;
+        CountingScheduler::Peak() = 0;
+        ObjectFactory factory("ns3::CountingScheduler");
+        Simulator::SetScheduler(factory);
+        EventCounting() = true;
+    }
+
+    void SetInterval(Time interval)
+    {
+        m_interval = interval;
+    }
+
+    void SetOutput(std::ostream* out)
+    {
+        m_out = out;
+    }
+
+    static void WriteHeader(std::ostream& out)
+    {
+        out << "Time(s),Category,Instances,Bytes\n";
+    }
+
+    static void WritePeaksHeader(std::ostream& out)
+    {
+        out << "Category,PeakInstances,PeakBytes,PeakBytesTime(s)\n";
+    }
+
+    void AddFlowMonitor(Ptr<FlowMonitor> monitor)
+    {
+        m_monitors.push_back(monitor);
+    }
+
+    // A structure of the experiment itself, e.g. the size of a per-flow map
+    void AddGauge(std::string name, std::function<uint64_t()> instances, uint64_t bytesPerInstance)
+    {
+        Gauge gauge;
+        gauge.name = name;
+        gauge.instances = instances;
+        gauge.bytesPerInstance = bytesPerInstance;
+        m_gauges.push_back(gauge);
+    }
+
+    void Start()
+    {
+        Simulator::ScheduleNow(&MemoryCensus::Sample, this);
+    }
+
+    // Takes a last sample, e.g. right before Simulator::Destroy()
+    void Finish()
+    {
+        Count counts;
+        Collect(counts);
+    }
+
+    void WritePeaks(std::ostream& out) const
+    {
+        for (std::map<std::string, Peak>::const_iterator it = m_peaks.begin(); it != m_peaks.end(); it++)
+        {
+            out << it->first << "," << it->second.instances << "," << it->second.bytes << ","
+                << it->second.bytesTime.GetSeconds() << "\n";
+        }
+    }
+
+    uint64_t GetPeakBytes(std::string category) const
+    {
+        std::map<std::string, Peak>::const_iterator it = m_peaks.find(category);
+        return it == m_peaks.end() ? 0 : it->second.bytes;
+    }
+
+  private:
+    struct Gauge
+    {
+        std::string name;
+        std::function<uint64_t()> instances;
+        uint64_t bytesPerInstance;
+    };
+
+    struct Peak
+    {
+        uint64_t instances = 0;
+        uint64_t bytes = 0;
+        Time bytesTime;
+    };
+
+    // Instances and bytes per category, sorted by name
+    typedef std::map<std::string, std::pair<uint64_t, uint64_t>> Count;
+
+    static bool& EventCounting()
+    {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    static uint64_t ResidentBytes()
+    {
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size = 0;
+        uint64_t resident = 0;
+        statm >> size >> resident;
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+
+    static void Add(Count& counts, const std::string& category, uint64_t instances, uint64_t bytes)
+    {
+        std::pair<uint64_t, uint64_t>& c = counts[category];
+        c.first += instances;
+        c.second += bytes;
+    }
+
+    void Collect(Count& counts)
+    {
+        Add(counts, "rss", 1, ResidentBytes());
+        if (EventCounting())
+        {
+            Add(counts, "events", CountingScheduler::Pending(), 0);
+        }
+        Add(counts, "nodes", NodeList::GetNNodes(), 0);
+        uint64_t txMax = 0;
+        uint64_t rxMax = 0;
+        for (NodeList::Iterator n = NodeList::Begin(); n != NodeList::End(); n++)
+        {
+            Ptr<Node> node = *n;
+            Ptr<TrafficControlLayer> tc = node->GetObject<TrafficControlLayer>();
+            for (uint32_t d = 0; d < node->GetNDevices(); d++)
+            {
+                Ptr<NetDevice> device = node->GetDevice(d);
+                PointerValue queue;
+                uint64_t bytes = 0;
+                if (device->GetAttributeFailSafe("TxQueue", queue) && queue.Get<QueueBase>())
+                {
+                    bytes = queue.Get<QueueBase>()->GetNBytes();
+                }
+                Add(counts, "device:" + device->GetInstanceTypeId().GetName(), 1, bytes);
+                Ptr<QueueDisc> qdisc = tc ? tc->GetRootQueueDiscOnDevice(device) : nullptr;
+                if (qdisc)
+                {
+                    Add(counts, "qdisc:" + qdisc->GetInstanceTypeId().GetName(), 1, qdisc->GetNBytes());
+                }
+            }
+            for (uint32_t a = 0; a < node->GetNApplications(); a++)
+            {
+                Add(counts, "app:" + node->GetApplication(a)->GetInstanceTypeId().GetName(), 1, 0);
+            }
+            Ptr<TcpL4Protocol> tcp = node->GetObject<TcpL4Protocol>();
+            if (!tcp)
+            {
+                continue;
+            }
+            ObjectVectorValue sockets;
+            tcp->GetAttribute("SocketList", sockets);
+            for (ObjectVectorValue::Iterator s = sockets.Begin(); s != sockets.End(); s++)
+            {
+                Ptr<TcpSocketBase> socket = DynamicCast<TcpSocketBase>(s->second);
+                if (!socket)
+                {
+                    continue;
+                }
+                uint64_t tx = socket->GetTxBuffer()->Size();
+                uint64_t rx = socket->GetRxBuffer()->Size();
+                txMax = std::max(txMax, tx);
+                rxMax = std::max(rxMax, rx);
+                Add(counts, "socket:" + socket->GetInstanceTypeId().GetName(), 1, tx + rx);
+            }
+        }
+        Add(counts, "tcp-tx-max", 1, txMax);
+        Add(counts, "tcp-rx-max", 1, rxMax);
+        for (Ptr<FlowMonitor> monitor : m_monitors)
+        {
+            const FlowMonitor::FlowStatsContainer& stats = monitor->GetFlowStats();
+            uint64_t bytes = 0;
+            for (FlowMonitor::FlowStatsContainerCI it = stats.begin(); it != stats.end(); it++)
+            {
+                const FlowMonitor::FlowStats& f = it->second;
+                bytes += sizeof(FlowMonitor::FlowStats) + 4 * (f.delayHistogram.GetNBins() + f.jitterHistogram.GetNBins() +
+                                                               f.packetSizeHistogram.GetNBins() +
+                                                               f.flowInterruptionsHistogram.GetNBins());
+            }
+            Add(counts, "flowmon", stats.size(), bytes);
+        }
+        for (const Gauge& gauge : m_gauges)
+        {
+            uint64_t instances = gauge.instances();
+            Add(counts, gauge.name, instances, instances * gauge.bytesPerInstance);
+        }
+
+        Time now = Simulator::Now();
+        for (Count::iterator it = counts.begin(); it != counts.end(); it++)
+        {
+            Peak& peak = m_peaks[it->first];
+            peak.instances = std::max(peak.instances, it->second.first);
+            if (it->second.second > peak.bytes)
+            {
+                peak.bytes = it->second.second;
+                peak.bytesTime = now;
+            }
+            if (m_out)
+            {
+                *m_out << now.GetSeconds() << "," << it->first << "," << it->second.first << "," << it->second.second
+                       << "\n";
+            }
+        }
+        if (EventCounting())
+        {
+            // Pending events can peak between two samples
+            Peak& events = m_peaks["events"];
+            events.instances = std::max(events.instances, CountingScheduler::Peak());
+        }
+    }
+
+    void Sample()
+    {
+        Count counts;
+        Collect(counts);
+        Simulator::Schedule(m_interval, &MemoryCensus::Sample, this);
+    }
+
+    Time m_interval;
+    std::ostream* m_out;
+    std::vector<Ptr<FlowMonitor>> m_monitors;
+    std::vector<Gauge> m_gauges;
+    std::map<std::string, Peak> m_peaks;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,292 @@
+/*
+Incident-triggered packet capture from in-memory rings.
+
+AddDevice(device, name) keeps the most recent packets seen by a
+point-to-point device (its "Sniffer" trace, both directions) in a ring of
+Capacity slots. Each slot holds the time, the original length and the first
+SnapLen bytes of the packet (PPP header included). Memory is Capacity *
+SnapLen bytes per device and is allocated once. Nothing is written while no
+trigger fires.
+
+A trigger flushes every ring to one pcap file per device,
+<prefix>-<capture>-<name>.pcap. The file holds the packets from Window
+before the trigger to PostTrigger after it, so the lead-up and the
+aftermath of the incident are both in it. Triggers that fire while a capture
+is pending, or within Holdoff of the last flush, are only counted, and at
+most MaxCaptures captures are written per run. Triggers:
+    TriggerOnQueue(qdisc, n)        an enqueue finds more than n packets queued
+    TriggerOnDrop(qdisc)            the queue disc drops a packet
+    TriggerOnMarks(qdisc, n, t)     n ECN marks within t
+    TriggerOnRto(socket)            a TCP socket enters CA_LOSS (retransmission timeout)
+AttachRtoApplication(app) does the same for an application that creates its
+socket on start (OnOff, BulkSend), on its first Tx. SetLog() writes one row
+per capture with its time, reason and the number of packets written.
+
+The ring is sized in packets, so Window is only fully covered when Capacity
+holds the packets of a Window at line rate (1Gbps of 1500B packets: about
+83 packets per ms).
+*/
+
+#ifndef PCAP_RING_CAPTURE_H
+#define PCAP_RING_CAPTURE_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <algorithm>
+#include <deque>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+class PcapRingCapture
+{
+  public:
+    PcapRingCapture(std::string prefix, Time window = MilliSeconds(10), uint32_t capacity = 4096, uint32_t snapLen = 128)
+        : m_prefix(prefix),
+          m_window(window),
+          m_postTrigger(MilliSeconds(1)),
+          m_holdoff(MilliSeconds(100)),
+          m_capacity(capacity),
+          m_snapLen(snapLen),
+          m_maxCaptures(100),
+          m_captures(0),
+          m_suppressed(0),
+          m_pending(false),
+          m_lastFlush(Time(-1)),
+          m_log(nullptr)
+    {
+    }
+
+    void SetPostTrigger(Time postTrigger)
+    {
+        m_postTrigger = postTrigger;
+    }
+
+    void SetHoldoff(Time holdoff)
+    {
+        m_holdoff = holdoff;
+    }
+
+    void SetMaxCaptures(uint32_t maxCaptures)
+    {
+        m_maxCaptures = maxCaptures;
+    }
+
+    void SetLog(std::ostream* log)
+    {
+        m_log = log;
+    }
+
+    static void WriteLogHeader(std::ostream& out)
+    {
+        out << "Capture,Trigger(s),Reason,Packets\n";
+    }
+
+    void AddDevice(Ptr<NetDevice> device, std::string name)
+    {
+        Ring ring;
+        ring.name = name;
+        ring.data.resize((size_t)m_capacity * m_snapLen);
+        ring.time.resize(m_capacity);
+        ring.length.resize(m_capacity);
+        ring.next = 0;
+        ring.count = 0;
+        m_rings.push_back(ring);
+        bool connected = device->TraceConnectWithoutContext(
+            "Sniffer",
+            MakeBoundCallback(&PcapRingCapture::OnSniff, this, (uint32_t)m_rings.size() - 1));
+        NS_ABORT_MSG_IF(!connected, "Device " << name << " has no Sniffer trace source");
+    }
+
+    void TriggerOnQueue(Ptr<QueueDisc> qdisc, uint32_t packets)
+    {
+        qdisc->TraceConnectWithoutContext("Enqueue",
+                                          MakeBoundCallback(&PcapRingCapture::OnEnqueue, this, PeekPointer(qdisc), packets));
+    }
+
+    void TriggerOnDrop(Ptr<QueueDisc> qdisc)
+    {
+        qdisc->TraceConnectWithoutContext("Drop", MakeCallback(&PcapRingCapture::OnDrop, this));
+    }
+
+    void TriggerOnMarks(Ptr<QueueDisc> qdisc, uint32_t marks, Time interval)
+    {
+        m_markBursts.push_back(MarkBurst());
+        m_markBursts.back().marks = marks;
+        m_markBursts.back().interval = interval;
+        qdisc->TraceConnectWithoutContext("Mark",
+                                          MakeBoundCallback(&PcapRingCapture::OnMark, this, (uint32_t)m_markBursts.size() - 1));
+    }
+
+    void TriggerOnRto(Ptr<Socket> socket)
+    {
+        socket->TraceConnectWithoutContext("CongState", MakeCallback(&PcapRingCapture::OnCongState, this));
+    }
+
+    template <class App>
+    void AttachRtoApplication(Ptr<App> app)
+    {
+        app->TraceConnectWithoutContext("Tx", MakeBoundCallback(&PcapRingCapture::FirstTx<App>, this, PeekPointer(app)));
+    }
+
+    void Trigger(std::string reason)
+    {
+        Time now = Simulator::Now();
+        if (m_pending || m_captures >= m_maxCaptures ||
+            (!m_lastFlush.IsNegative() && now - m_lastFlush < m_holdoff))
+        {
+            m_suppressed++;
+            return;
+        }
+        m_pending = true;
+        Simulator::Schedule(m_postTrigger, &PcapRingCapture::Flush, this, now, reason);
+    }
+
+    uint32_t GetCaptures() const
+    {
+        return m_captures;
+    }
+
+    // Triggers that did not start a capture
+    uint64_t GetSuppressed() const
+    {
+        return m_suppressed;
+    }
+
+  private:
+    struct Ring
+    {
+        std::string name;
+        std::vector<uint8_t> data;
+        std::vector<int64_t> time; // ns
+        std::vector<uint32_t> length;
+        uint32_t next;
+        uint64_t count;
+    };
+
+    struct MarkBurst
+    {
+        uint32_t marks;
+        Time interval;
+        std::deque<Time> times;
+    };
+
+    static void OnSniff(PcapRingCapture* capture, uint32_t index, Ptr<const Packet> packet)
+    {
+        Ring& ring = capture->m_rings[index];
+        uint32_t slot = ring.next;
+        uint32_t size = packet->GetSize();
+        packet->CopyData(&ring.data[(size_t)slot * capture->m_snapLen], std::min(size, capture->m_snapLen));
+        ring.time[slot] = Simulator::Now().GetNanoSeconds();
+        ring.length[slot] = size;
+        ring.next = slot + 1 == capture->m_capacity ? 0 : slot + 1;
+        ring.count++;
+    }
+
+    static void OnEnqueue(PcapRingCapture* capture, QueueDisc* qdisc, uint32_t packets, Ptr<const QueueDiscItem> item)
+    {
+        if (qdisc->GetNPackets() > packets)
+        {
+            capture->Trigger("queue");
+        }
+    }
+
+    void OnDrop(Ptr<const QueueDiscItem> item)
+    {
+        Trigger("drop");
+    }
+
+    static void OnMark(PcapRingCapture* capture, uint32_t index, Ptr<const QueueDiscItem> item, const char* reason)
+    {
+        MarkBurst& burst = capture->m_markBursts[index];
+        Time now = Simulator::Now();
+        burst.times.push_back(now);
+        while (now - burst.times.front() > burst.interval)
+        {
+            burst.times.pop_front();
+        }
+        if (burst.times.size() >= burst.marks)
+        {
+            burst.times.clear();
+            capture->Trigger("marks");
+        }
+    }
+
+    void OnCongState(TcpSocketState::TcpCongState_t oldValue, TcpSocketState::TcpCongState_t newValue)
+    {
+        if (newValue == TcpSocketState::CA_LOSS && oldValue != TcpSocketState::CA_LOSS)
+        {
+            Trigger("rto");
+        }
+    }
+
+    template <class App>
+    static void FirstTx(PcapRingCapture* capture, App* app, Ptr<const Packet> packet)
+    {
+        Ptr<Socket> socket = app->GetSocket();
+        if (socket && capture->m_rtoSockets.insert(PeekPointer(socket)).second)
+        {
+            capture->TriggerOnRto(socket);
+        }
+    }
+
+    void Flush(Time trigger, std::string reason)
+    {
+        m_pending = false;
+        m_lastFlush = Simulator::Now();
+        int64_t from = (trigger - m_window).GetNanoSeconds();
+        uint64_t written = 0;
+        for (const Ring& ring : m_rings)
+        {
+            PcapFile file;
+            file.Open(m_prefix + "-" + std::to_string(m_captures) + "-" + ring.name + ".pcap", std::ios::out);
+            file.Init(PcapHelper::DLT_PPP, m_snapLen);
+            uint64_t size = std::min<uint64_t>(ring.count, m_capacity);
+            uint32_t start = ring.count > m_capacity ? ring.next : 0;
+            for (uint64_t i = 0; i < size; i++)
+            {
+                uint32_t slot = (start + i) % m_capacity;
+                if (ring.time[slot] < from)
+                {
+                    continue;
+                }
+                file.Write(ring.time[slot] / 1000000000, ring.time[slot] % 1000000000 / 1000,
+                           &ring.data[(size_t)slot * m_snapLen], ring.length[slot]);
+                written++;
+            }
+            file.Close();
+        }
+        if (m_log)
+        {
+            *m_log << m_captures << "," << trigger.GetSeconds() << "," << reason << "," << written << "\n";
+        }
+        m_captures++;
+    }
+
+    std::string m_prefix;
+    Time m_window;
+    Time m_postTrigger;
+    Time m_holdoff;
+    uint32_t m_capacity;
+    uint32_t m_snapLen;
+    uint32_t m_maxCaptures;
+    uint32_t m_captures;
+    uint64_t m_suppressed;
+    bool m_pending;
+    Time m_lastFlush;
+    std::ostream* m_log;
+    std::vector<Ring> m_rings;
+    std::deque<MarkBurst> m_markBursts;
+    std::set<Socket*> m_rtoSockets;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,445 @@
+/*
+Priority Flow Control (802.1Qbb) model for lossless point-to-point fabrics.
+
+PfcQueueDisc is the egress queue pair of a PFC port: one FIFO per priority
+(IPv4 precedence, TOS >> 5), strict priority between them, and a paused flag
+per priority. A paused priority is skipped by the dequeue, so its packets
+wait in the queue disc while other priorities keep flowing.
+
+PfcSwitch does the per-port, per-priority ingress accounting of a switch or
+router. Every forwarded packet is tagged with its ingress interface and
+priority when it is received and charged to that ingress counter until it
+leaves through an egress queue disc or is dropped, either by the egress
+queue disc (overflow) or by the IP layer (TTL expiry, no route), so no
+drop leaves the counter above Xon. When a counter
+goes above Xoff, a PAUSE for that priority is sent to the upstream egress
+port; when it falls to Xon, a RESUME is sent. Pause frames are modelled as
+control messages that take the link propagation delay plus the
+serialization time of a 64 byte frame, so back-pressure propagates hop by
+hop towards the senders exactly like head-of-line blocking in a real
+lossless fabric.
+
+PfcHelper installs the queue discs on both ends of a link (hosts included,
+so hosts can be paused as well) and shrinks the device transmit queues so
+pauses take effect without a large in-device backlog. Links must be
+installed before IPv4 addresses are assigned, like any TrafficControlHelper.
+*/
+
+#ifndef PFC_H
+#define PFC_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+namespace ns3
+{
+
+class PfcTag : public Tag
+{
+  public:
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::PfcTag").SetParent<Tag>().SetGroupName("Network").AddConstructor<PfcTag>();
+        return tid;
+    }
+
+    TypeId GetInstanceTypeId() const override
+    {
+        return GetTypeId();
+    }
+
+    uint32_t GetSerializedSize() const override
+    {
+        return 5;
+    }
+
+    void Serialize(TagBuffer i) const override
+    {
+        i.WriteU32(ingress);
+        i.WriteU8(priority);
+    }
+
+    void Deserialize(TagBuffer i) override
+    {
+        ingress = i.ReadU32();
+        priority = i.ReadU8();
+    }
+
+    void Print(std::ostream& os) const override
+    {
+        os << "ingress=" << ingress << " priority=" << (uint32_t)priority;
+    }
+
+    uint32_t ingress = 0;
+    uint8_t priority = 0;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(PfcTag);
+
+class PfcQueueDisc : public QueueDisc
+{
+  public:
+    static const uint32_t PRIORITIES = 8;
+    static constexpr const char* LIMIT_EXCEEDED_DROP = "PFC buffer overflow";
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::PfcQueueDisc")
+                .SetParent<QueueDisc>()
+                .SetGroupName("TrafficControl")
+                .AddConstructor<PfcQueueDisc>()
+                .AddAttribute("MaxSize",
+                              "Buffer of the port; a drop here means the PFC headroom was too small",
+                              QueueSizeValue(QueueSize("10000p")),
+                              MakeQueueSizeAccessor(&QueueDisc::SetMaxSize, &QueueDisc::GetMaxSize),
+                              MakeQueueSizeChecker());
+        return tid;
+    }
+
+    PfcQueueDisc()
+        : QueueDisc(QueueDiscSizePolicy::MULTIPLE_QUEUES, QueueSizeUnit::PACKETS)
+    {
+        for (uint32_t p = 0; p < PRIORITIES; p++)
+        {
+            m_paused[p] = false;
+        }
+    }
+
+    static uint8_t Classify(Ptr<const QueueDiscItem> item)
+    {
+        Ptr<const Ipv4QueueDiscItem> ipItem = DynamicCast<const Ipv4QueueDiscItem>(item);
+        return ipItem ? ipItem->GetHeader().GetTos() >> 5 : 0;
+    }
+
+    bool IsPaused(uint8_t priority) const
+    {
+        return m_paused[priority];
+    }
+
+    void SetPaused(uint8_t priority, bool paused)
+    {
+        m_paused[priority] = paused;
+        if (!paused)
+        {
+            // Restart transmission of the packets held back by the pause
+            Run();
+        }
+    }
+
+  private:
+    bool DoEnqueue(Ptr<QueueDiscItem> item) override
+    {
+        if (GetCurrentSize() + item > GetMaxSize())
+        {
+            DropBeforeEnqueue(item, LIMIT_EXCEEDED_DROP);
+            return false;
+        }
+        return GetInternalQueue(Classify(item))->Enqueue(item);
+    }
+
+    Ptr<QueueDiscItem> DoDequeue() override
+    {
+        for (uint32_t p = PRIORITIES; p-- > 0;)
+        {
+            if (!m_paused[p] && !GetInternalQueue(p)->IsEmpty())
+            {
+                return GetInternalQueue(p)->Dequeue();
+            }
+        }
+        return nullptr;
+    }
+
+    Ptr<const QueueDiscItem> DoPeek() override
+    {
+        for (uint32_t p = PRIORITIES; p-- > 0;)
+        {
+            if (!m_paused[p] && !GetInternalQueue(p)->IsEmpty())
+            {
+                return GetInternalQueue(p)->Peek();
+            }
+        }
+        return nullptr;
+    }
+
+    bool CheckConfig() override
+    {
+        if (GetNQueueDiscClasses() > 0 || GetNPacketFilters() > 0)
+        {
+            NS_LOG_UNCOND("PfcQueueDisc cannot have classes or packet filters");
+            return false;
+        }
+        while (GetNInternalQueues() < PRIORITIES)
+        {
+            AddInternalQueue(CreateObjectWithAttributes<DropTailQueue<QueueDiscItem>>(
+                "MaxSize",
+                QueueSizeValue(GetMaxSize())));
+        }
+        return GetNInternalQueues() == PRIORITIES;
+    }
+
+    void InitializeParams() override
+    {
+    }
+
+    bool m_paused[PRIORITIES];
+};
+
+NS_OBJECT_ENSURE_REGISTERED(PfcQueueDisc);
+
+class PfcSwitch : public Object
+{
+  public:
+    static TypeId GetTypeId()
+    {
+        static TypeId tid = TypeId("ns3::PfcSwitch").SetParent<Object>().SetGroupName("Network");
+        return tid;
+    }
+
+    PfcSwitch(uint64_t xoff, uint64_t xon)
+        : m_xoff(xoff),
+          m_xon(xon),
+          m_log(nullptr)
+    {
+    }
+
+    void SetLog(std::ostream* log)
+    {
+        m_log = log;
+    }
+
+    static void WriteLogHeader(std::ostream& out)
+    {
+        out << "Time(us),Node,Interface,Priority,Event,IngressBytes\n";
+    }
+
+    // Hook the node's IPv4 receive path and every PFC egress queue disc
+    void Install(Ptr<Node> node)
+    {
+        m_node = node;
+        m_ipv4 = node->GetObject<Ipv4L3Protocol>();
+        uint32_t nInterfaces = m_ipv4->GetNInterfaces();
+        m_ports.resize(nInterfaces);
+        Ptr<TrafficControlLayer> tc = node->GetObject<TrafficControlLayer>();
+        for (uint32_t i = 0; i < nInterfaces; i++)
+        {
+            Port& port = m_ports[i];
+            for (uint32_t p = 0; p < PfcQueueDisc::PRIORITIES; p++)
+            {
+                port.ingressBytes[p] = 0;
+                port.pausing[p] = false;
+                port.pausedTime[p] = Time(0);
+            }
+            Ptr<PointToPointNetDevice> device = DynamicCast<PointToPointNetDevice>(m_ipv4->GetNetDevice(i));
+            if (!device)
+            {
+                continue;
+            }
+            Ptr<PointToPointChannel> channel = DynamicCast<PointToPointChannel>(device->GetChannel());
+            Ptr<NetDevice> peer = channel->GetDevice(0) == device ? channel->GetDevice(1) : channel->GetDevice(0);
+            Ptr<TrafficControlLayer> peerTc = peer->GetNode()->GetObject<TrafficControlLayer>();
+            port.upstream = DynamicCast<PfcQueueDisc>(peerTc->GetRootQueueDiscOnDevice(peer));
+            TimeValue delay;
+            channel->GetAttribute("Delay", delay);
+            DataRateValue rate;
+            device->GetAttribute("DataRate", rate);
+            port.pauseDelay = delay.Get() + rate.Get().CalculateBytesTxTime(64);
+
+            Ptr<QueueDisc> egress = tc->GetRootQueueDiscOnDevice(device);
+            if (egress)
+            {
+                egress->TraceConnectWithoutContext("Dequeue", MakeCallback(&PfcSwitch::OnEgress, this));
+                egress->TraceConnectWithoutContext("Drop", MakeCallback(&PfcSwitch::OnEgress, this));
+            }
+        }
+        m_ipv4->TraceConnectWithoutContext("Rx", MakeCallback(&PfcSwitch::OnRx, this));
+        m_ipv4->TraceConnectWithoutContext("Drop", MakeCallback(&PfcSwitch::OnIpDrop, this));
+    }
+
+    Time GetPausedTime(uint32_t interface, uint8_t priority) const
+    {
+        const Port& port = m_ports[interface];
+        Time paused = port.pausedTime[priority];
+        if (port.pausing[priority])
+        {
+            paused += Simulator::Now() - port.pauseStart[priority];
+        }
+        return paused;
+    }
+
+  private:
+    struct Port
+    {
+        Ptr<PfcQueueDisc> upstream;
+        Time pauseDelay;
+        uint64_t ingressBytes[PfcQueueDisc::PRIORITIES];
+        bool pausing[PfcQueueDisc::PRIORITIES];
+        Time pauseStart[PfcQueueDisc::PRIORITIES];
+        Time pausedTime[PfcQueueDisc::PRIORITIES];
+    };
+
+    void OnRx(Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+    {
+        Ipv4Header header;
+        packet->PeekHeader(header);
+        if (m_ipv4->IsDestinationAddress(header.GetDestination(), interface) ||
+            header.GetDestination().IsBroadcast() || header.GetDestination().IsMulticast())
+        {
+            return;
+        }
+        PfcTag tag;
+        tag.ingress = interface;
+        tag.priority = header.GetTos() >> 5;
+        packet->AddPacketTag(tag);
+
+        Port& port = m_ports[interface];
+        port.ingressBytes[tag.priority] += packet->GetSize();
+        if (!port.pausing[tag.priority] && port.ingressBytes[tag.priority] > m_xoff)
+        {
+            SendPause(interface, tag.priority, true);
+        }
+    }
+
+    // Dequeued or dropped by an egress queue disc
+    void OnEgress(Ptr<const QueueDiscItem> item)
+    {
+        PfcTag tag;
+        if (!item->GetPacket()->RemovePacketTag(tag))
+        {
+            return;
+        }
+        Release(tag, item->GetSize());
+    }
+
+    // Dropped between the receive path and the egress queue disc
+    void OnIpDrop(const Ipv4Header& header,
+                  Ptr<const Packet> packet,
+                  Ipv4L3Protocol::DropReason reason,
+                  Ptr<Ipv4> ipv4,
+                  uint32_t interface)
+    {
+        PfcTag tag;
+        if (!packet->PeekPacketTag(tag))
+        {
+            return;
+        }
+        // The tag stays on the dropped packet, which is never seen again
+        Release(tag, packet->GetSize() + header.GetSerializedSize());
+    }
+
+    void Release(const PfcTag& tag, uint64_t size)
+    {
+        Port& port = m_ports[tag.ingress];
+        uint64_t& bytes = port.ingressBytes[tag.priority];
+        bytes -= std::min<uint64_t>(bytes, size);
+        if (port.pausing[tag.priority] && bytes <= m_xon)
+        {
+            SendPause(tag.ingress, tag.priority, false);
+        }
+    }
+
+    void SendPause(uint32_t interface, uint8_t priority, bool pause)
+    {
+        Port& port = m_ports[interface];
+        port.pausing[priority] = pause;
+        if (pause)
+        {
+            port.pauseStart[priority] = Simulator::Now();
+        }
+        else
+        {
+            port.pausedTime[priority] += Simulator::Now() - port.pauseStart[priority];
+        }
+        if (m_log)
+        {
+            *m_log << Simulator::Now().GetMicroSeconds() << "," << m_node->GetId() << "," << interface << ","
+                   << (uint32_t)priority << "," << (pause ? "XOFF" : "XON") << ","
+                   << port.ingressBytes[priority] << "\n";
+        }
+        if (port.upstream)
+        {
+            Simulator::Schedule(port.pauseDelay, &PfcQueueDisc::SetPaused, port.upstream, priority, pause);
+        }
+    }
+
+    uint64_t m_xoff;
+    uint64_t m_xon;
+    std::ostream* m_log;
+    Ptr<Node> m_node;
+    Ptr<Ipv4L3Protocol> m_ipv4;
+    std::vector<Port> m_ports;
+};
+
+class PfcHelper
+{
+  public:
+    PfcHelper()
+        : m_xoff(60000),
+          m_xon(30000),
+          m_bufferSize("10000p"),
+          m_deviceQueueSize("2p"),
+          m_log(nullptr)
+    {
+    }
+
+    // Ingress thresholds per port and priority, in bytes
+    void SetThresholds(uint64_t xoff, uint64_t xon)
+    {
+        m_xoff = xoff;
+        m_xon = xon;
+    }
+
+    void SetBufferSize(QueueSize size)
+    {
+        m_bufferSize = size;
+    }
+
+    void SetLog(std::ostream* log)
+    {
+        m_log = log;
+    }
+
+    QueueDiscContainer InstallLink(NetDeviceContainer link)
+    {
+        for (NetDeviceContainer::Iterator i = link.Begin(); i != link.End(); ++i)
+        {
+            Ptr<PointToPointNetDevice> device = DynamicCast<PointToPointNetDevice>(*i);
+            if (device)
+            {
+                device->GetQueue()->SetMaxSize(m_deviceQueueSize);
+            }
+        }
+        TrafficControlHelper tch;
+        tch.SetRootQueueDisc("ns3::PfcQueueDisc", "MaxSize", QueueSizeValue(m_bufferSize));
+        return tch.Install(link);
+    }
+
+    // Call once every link of the node has been installed
+    Ptr<PfcSwitch> InstallSwitch(Ptr<Node> node)
+    {
+        Ptr<PfcSwitch> sw = CreateObject<PfcSwitch>(m_xoff, m_xon);
+        sw->SetLog(m_log);
+        sw->Install(node);
+        node->AggregateObject(sw);
+        return sw;
+    }
+
+  private:
+    uint64_t m_xoff;
+    uint64_t m_xon;
+    QueueSize m_bufferSize;
+    QueueSize m_deviceQueueSize;
+    std::ostream* m_log;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,208 @@
+/*
+Live progress and ETA reporting for long simulations.
+
+The reporter runs as a simulator event, but it is throttled by wall-clock
+time: the simulated step between two checks is adapted so that a check
+happens roughly every quarter of the report interval, and a report is only
+emitted once the wall-clock interval has elapsed. The step shrinks at once
+when a check comes late, grows at most 2x per check and never exceeds
+MaxStep, so after an idle phase (think times, gaps between flows) the next
+busy phase is still reported on time. The cost is a handful of events and
+clock reads per wall second, independent of the simulated rate.
+
+The ETA is computed against the stop time, or against the estimate of
+SetStopEstimate() for runs that can end early (e.g. SteadyStateController).
+
+Each report gives the simulated time, events executed per wall second, the
+simulated/wall time ratio and the ETA. It goes to stderr as one line and,
+when a status file is set, is also written into a memory-mapped file that
+can be watched with `watch cat <file>` without any write syscalls.
+*/
+
+#ifndef PROGRESS_REPORTER_H
+#define PROGRESS_REPORTER_H
+
+#include "ns3/core-module.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ns3
+{
+
+class ProgressReporter
+{
+  public:
+    static const size_t STATUS_SIZE = 256;
+
+    ProgressReporter(Time stopTime, Time wallInterval = Seconds(1))
+        : m_stopTime(stopTime),
+          m_wallInterval(std::chrono::duration<double>(wallInterval.GetSeconds())),
+          m_step(MilliSeconds(1)),
+          m_maxStep(MilliSeconds(100)),
+          m_stderr(true),
+          m_status(nullptr),
+          m_lastEvents(0)
+    {
+    }
+
+    ~ProgressReporter()
+    {
+        if (m_status)
+        {
+            munmap(m_status, STATUS_SIZE);
+        }
+    }
+
+    void SetMaxStep(Time step)
+    {
+        m_maxStep = step;
+    }
+
+    // Expected end of the run, used for the ETA when it is before the stop time
+    void SetStopEstimate(std::function<Time()> estimate)
+    {
+        m_stopEstimate = estimate;
+    }
+
+    void EnableStderr(bool enable)
+    {
+        m_stderr = enable;
+    }
+
+    void EnableStatusFile(std::string path)
+    {
+        if (path.empty())
+        {
+            return;
+        }
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, STATUS_SIZE) != 0)
+        {
+            NS_FATAL_ERROR("Cannot create status file " << path);
+        }
+        void* status = mmap(nullptr, STATUS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (status == MAP_FAILED)
+        {
+            NS_FATAL_ERROR("Cannot map status file " << path);
+        }
+        m_status = static_cast<char*>(status);
+        std::memset(m_status, ' ', STATUS_SIZE);
+    }
+
+    void Start()
+    {
+        m_wallStart = m_lastWall = m_lastReport = Clock::now();
+        m_simStart = m_lastSim = Simulator::Now();
+        m_lastEvents = Simulator::GetEventCount();
+        Simulator::ScheduleNow(&ProgressReporter::Check, this);
+    }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    void Check()
+    {
+        Clock::time_point now = Clock::now();
+        double sinceCheck = std::chrono::duration<double>(now - m_lastWall).count();
+        double target = m_wallInterval.count() / 4;
+
+        // Aim for four checks per report: shrink at once when late, grow slowly when early
+        if (sinceCheck > 0)
+        {
+            double scale = std::min(target / sinceCheck, 2.0);
+            m_step = std::max(NanoSeconds(1), m_step * scale);
+        }
+        else
+        {
+            m_step = m_step * 2;
+        }
+        m_step = std::min(m_step, m_maxStep);
+        m_lastWall = now;
+
+        if (now - m_lastReport >= m_wallInterval)
+        {
+            Report(now);
+        }
+        if (Simulator::Now() + m_step < m_stopTime)
+        {
+            Simulator::Schedule(m_step, &ProgressReporter::Check, this);
+        }
+    }
+
+    void Report(Clock::time_point now)
+    {
+        double wall = std::chrono::duration<double>(now - m_lastReport).count();
+        double sim = (Simulator::Now() - m_lastSim).GetSeconds();
+        uint64_t events = Simulator::GetEventCount();
+        double eventRate = (events - m_lastEvents) / wall;
+        double ratio = sim / wall;
+        Time stop = m_stopTime;
+        if (m_stopEstimate)
+        {
+            Time estimate = m_stopEstimate();
+            if (estimate.IsStrictlyPositive())
+            {
+                stop = std::max(std::min(estimate, m_stopTime), Simulator::Now());
+            }
+        }
+        double remaining = (stop - Simulator::Now()).GetSeconds();
+        double eta = ratio > 0 ? remaining / ratio : -1;
+        double elapsed = std::chrono::duration<double>(now - m_wallStart).count();
+        double total = (m_stopTime - m_simStart).GetSeconds();
+        double percent = total > 0 ? 100.0 * (Simulator::Now() - m_simStart).GetSeconds() / total : 100.0;
+
+        char line[STATUS_SIZE];
+        int length = std::snprintf(line,
+                                   sizeof(line),
+                                   "sim %.3fs (%.1f%%) | %.0f events/s | sim/wall %.4f | wall %.0fs | ETA %.0fs",
+                                   Simulator::Now().GetSeconds(),
+                                   percent,
+                                   eventRate,
+                                   ratio,
+                                   elapsed,
+                                   eta);
+        length = std::min<int>(length, STATUS_SIZE - 1);
+        if (m_stderr)
+        {
+            std::fprintf(stderr, "%s\n", line);
+        }
+        if (m_status)
+        {
+            std::memcpy(m_status, line, length);
+            std::memset(m_status + length, ' ', STATUS_SIZE - 1 - length);
+            m_status[STATUS_SIZE - 1] = '\n';
+        }
+
+        m_lastReport = now;
+        m_lastSim = Simulator::Now();
+        m_lastEvents = events;
+    }
+
+    Time m_stopTime;
+    std::chrono::duration<double> m_wallInterval;
+    Time m_step;
+    Time m_maxStep;
+    std::function<Time()> m_stopEstimate;
+    bool m_stderr;
+    char* m_status;
+
+    Clock::time_point m_wallStart;
+    Clock::time_point m_lastWall;
+    Clock::time_point m_lastReport;
+    Time m_simStart;
+    Time m_lastSim;
+    uint64_t m_lastEvents;
+};
+
+} // namespace ns3
+
+#endif
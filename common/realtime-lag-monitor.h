@@ -0,0 +1,120 @@
+/*
+Scheduler lag instrumentation for real-time emulation.
+
+Under RealtimeSimulatorImpl every event is meant to run when the wall clock
+reaches its timestamp. When the simulator cannot keep up, events run late
+and the emulated links are slower than configured. The monitor schedules a
+probe every Interval and measures how late it runs: wall-clock time
+(RealtimeNow) minus its simulated timestamp. Once per Window it writes the
+mean and maximum lag, the number of probes and the number of probes later
+than Threshold. A maximum lag that keeps growing means the emulator has
+fallen behind for good.
+*/
+
+#ifndef REALTIME_LAG_MONITOR_H
+#define REALTIME_LAG_MONITOR_H
+
+#include "ns3/core-module.h"
+#include "ns3/realtime-simulator-impl.h"
+
+#include <algorithm>
+#include <ostream>
+
+namespace ns3
+{
+
+class RealtimeLagMonitor
+{
+  public:
+    RealtimeLagMonitor(Time interval = MilliSeconds(1), Time window = Seconds(1))
+        : m_interval(interval),
+          m_window(window),
+          m_threshold(MilliSeconds(1)),
+          m_out(nullptr)
+    {
+        ResetWindow();
+        m_totalProbes = 0;
+        m_totalLate = 0;
+    }
+
+    // Probes later than this count as overruns
+    void SetThreshold(Time threshold)
+    {
+        m_threshold = threshold;
+    }
+
+    static void WriteHeader(std::ostream& out)
+    {
+        out << "Time(ms),MeanLag(us),MaxLag(us),Probes,Late\n";
+    }
+
+    void Start(std::ostream& out)
+    {
+        m_impl = DynamicCast<RealtimeSimulatorImpl>(Simulator::GetImplementation());
+        if (!m_impl)
+        {
+            NS_FATAL_ERROR("RealtimeLagMonitor needs SimulatorImplementationType=ns3::RealtimeSimulatorImpl");
+        }
+        m_out = &out;
+        m_windowEnd = Simulator::Now() + m_window;
+        Simulator::Schedule(m_interval, &RealtimeLagMonitor::Probe, this);
+    }
+
+    void PrintSummary(std::ostream& out) const
+    {
+        out << "Scheduler lag: max " << m_worst.GetMicroSeconds() << "us, " << m_totalLate << " of "
+            << m_totalProbes << " probes later than " << m_threshold.GetMicroSeconds() << "us\n";
+    }
+
+  private:
+    void ResetWindow()
+    {
+        m_sum = Time(0);
+        m_max = Time(0);
+        m_probes = 0;
+        m_late = 0;
+    }
+
+    void Probe()
+    {
+        Time lag = std::max(m_impl->RealtimeNow() - Simulator::Now(), Time(0));
+        m_sum += lag;
+        m_max = std::max(m_max, lag);
+        m_worst = std::max(m_worst, lag);
+        m_probes++;
+        m_totalProbes++;
+        if (lag > m_threshold)
+        {
+            m_late++;
+            m_totalLate++;
+        }
+        if (Simulator::Now() >= m_windowEnd)
+        {
+            *m_out << Simulator::Now().GetMilliSeconds() << "," << m_sum.GetMicroSeconds() / m_probes << ","
+                   << m_max.GetMicroSeconds() << "," << m_probes << "," << m_late << "\n";
+            m_out->flush();
+            ResetWindow();
+            m_windowEnd += m_window;
+        }
+        Simulator::Schedule(m_interval, &RealtimeLagMonitor::Probe, this);
+    }
+
+    Time m_interval;
+    Time m_window;
+    Time m_threshold;
+    std::ostream* m_out;
+    Ptr<RealtimeSimulatorImpl> m_impl;
+
+    Time m_windowEnd;
+    Time m_sum;
+    Time m_max;
+    Time m_worst;
+    uint32_t m_probes;
+    uint32_t m_late;
+    uint64_t m_totalProbes;
+    uint64_t m_totalLate;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,278 @@
+/*
+Multi-resolution rollups and plot-ready decimation of sampled time series.
+
+Sampling a queue or a flow rate every ms over a 50-100 s run gives far more
+points than a figure can show, and averaging them afterwards hides the DDL
+bursts. RollupWriter takes the samples as they are produced, Add(key, value)
+at the current time, and keeps per series (one key per flow or queue) one
+open bucket per resolution (1ms, 10ms, 100ms and 1s by default). A bucket is
+written to <prefix>-<resolution>.csv when the first sample of the next one
+arrives, with the min, max, mean and last value and the number of samples,
+so a spike stays visible in the max of every resolution.
+
+<prefix>-lttb.csv holds a shape-preserving decimation of each series for
+plotting: the first and last samples plus one sample per DecimationInterval,
+chosen as in Largest-Triangle-Three-Buckets. The sample of a bucket is the
+one that spans the largest triangle with the sample kept from the previous
+bucket and the mean of the next bucket, so the selection runs one bucket
+behind the samples. Only the samples of two decimation buckets and one
+bucket per resolution are held per series. Finish() writes the buckets
+still open.
+*/
+
+#ifndef ROLLUP_WRITER_H
+#define ROLLUP_WRITER_H
+
+#include "ns3/core-module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ns3
+{
+
+class RollupWriter
+{
+  public:
+    RollupWriter()
+        : m_decimation(MilliSeconds(100)),
+          m_keyed(false),
+          m_rows(0)
+    {
+        m_resolutions.push_back(MilliSeconds(1));
+        m_resolutions.push_back(MilliSeconds(10));
+        m_resolutions.push_back(MilliSeconds(100));
+        m_resolutions.push_back(Seconds(1));
+    }
+
+    void SetResolutions(std::vector<Time> resolutions)
+    {
+        m_resolutions = resolutions;
+    }
+
+    void SetDecimationInterval(Time interval)
+    {
+        m_decimation = interval;
+    }
+
+    // keyHeader names the key columns ("Flow ID", "Source IP,Source Port,...") or is empty for a single series
+    void Open(std::string prefix, std::string keyHeader, std::string valueHeader)
+    {
+        m_keyed = !keyHeader.empty();
+        std::string key = m_keyed ? keyHeader + "," : "";
+        m_files.resize(m_resolutions.size());
+        for (uint32_t i = 0; i < m_resolutions.size(); i++)
+        {
+            m_files[i].open(prefix + "-" + Name(m_resolutions[i]) + ".csv");
+            m_files[i].precision(10);
+            m_files[i] << key << "Time(s),Min,Max,Mean,Last,Samples\n";
+        }
+        m_lttb.open(prefix + "-lttb.csv");
+        m_lttb.precision(10);
+        m_lttb << key << "Time(s)," << valueHeader << "\n";
+    }
+
+    void Add(const std::string& key, double value)
+    {
+        int64_t now = Simulator::Now().GetNanoSeconds();
+        std::pair<std::map<std::string, Series>::iterator, bool> it = m_series.emplace(key, Series());
+        Series& s = it.first->second;
+        if (it.second)
+        {
+            // The first sample is kept as is, the rollups still count it
+            s.buckets.resize(m_resolutions.size());
+            s.decimationBucket = now / m_decimation.GetNanoSeconds();
+            s.selected = Point(now * 1e-9, value);
+            WriteLttb(key, s.selected);
+        }
+        else
+        {
+            if (now / m_decimation.GetNanoSeconds() != s.decimationBucket)
+            {
+                s.decimationBucket = now / m_decimation.GetNanoSeconds();
+                SelectPending(key, s);
+                s.pending.swap(s.current);
+                s.current.clear();
+            }
+            s.current.push_back(Point(now * 1e-9, value));
+        }
+
+        for (uint32_t i = 0; i < m_resolutions.size(); i++)
+        {
+            Bucket& b = s.buckets[i];
+            int64_t index = now / m_resolutions[i].GetNanoSeconds();
+            if (b.samples > 0 && index != b.index)
+            {
+                WriteBucket(i, key, b);
+                b.samples = 0;
+            }
+            if (b.samples == 0)
+            {
+                b.index = index;
+                b.min = b.max = value;
+                b.sum = 0;
+            }
+            b.min = std::min(b.min, value);
+            b.max = std::max(b.max, value);
+            b.sum += value;
+            b.last = value;
+            b.samples++;
+        }
+    }
+
+    void Finish()
+    {
+        for (std::map<std::string, Series>::iterator it = m_series.begin(); it != m_series.end(); it++)
+        {
+            Series& s = it->second;
+            SelectPending(it->first, s);
+            if (!s.current.empty())
+            {
+                WriteLttb(it->first, s.current.back());
+            }
+            s.pending.clear();
+            s.current.clear();
+            for (uint32_t i = 0; i < m_resolutions.size(); i++)
+            {
+                if (s.buckets[i].samples > 0)
+                {
+                    WriteBucket(i, it->first, s.buckets[i]);
+                    s.buckets[i].samples = 0;
+                }
+            }
+        }
+        for (std::ofstream& file : m_files)
+        {
+            file.close();
+        }
+        m_lttb.close();
+    }
+
+    // Rows written to all rollup and decimation files
+    uint64_t GetRows() const
+    {
+        return m_rows;
+    }
+
+  private:
+    typedef std::pair<double, double> Point; // seconds, value
+
+    struct Bucket
+    {
+        Bucket()
+            : index(0),
+              min(0),
+              max(0),
+              sum(0),
+              last(0),
+              samples(0)
+        {
+        }
+
+        int64_t index;
+        double min;
+        double max;
+        double sum;
+        double last;
+        uint32_t samples;
+    };
+
+    struct Series
+    {
+        std::vector<Bucket> buckets;
+        int64_t decimationBucket;
+        Point selected;
+        std::vector<Point> pending;
+        std::vector<Point> current;
+    };
+
+    static std::string Name(Time resolution)
+    {
+        int64_t ns = resolution.GetNanoSeconds();
+        if (ns % 1000000000 == 0)
+        {
+            return std::to_string(ns / 1000000000) + "s";
+        }
+        if (ns % 1000000 == 0)
+        {
+            return std::to_string(ns / 1000000) + "ms";
+        }
+        return std::to_string(ns / 1000) + "us";
+    }
+
+    // Keeps the pending sample with the largest triangle towards the mean of the current bucket
+    void SelectPending(const std::string& key, Series& s)
+    {
+        if (s.pending.empty())
+        {
+            return;
+        }
+        Point next = s.selected;
+        if (!s.current.empty())
+        {
+            next = Point(0, 0);
+            for (const Point& p : s.current)
+            {
+                next.first += p.first;
+                next.second += p.second;
+            }
+            next.first /= s.current.size();
+            next.second /= s.current.size();
+        }
+        const Point& a = s.selected;
+        uint32_t best = 0;
+        double bestArea = -1;
+        for (uint32_t i = 0; i < s.pending.size(); i++)
+        {
+            const Point& b = s.pending[i];
+            double area = std::fabs((a.first - next.first) * (b.second - a.second) -
+                                    (a.first - b.first) * (next.second - a.second));
+            if (area > bestArea)
+            {
+                bestArea = area;
+                best = i;
+            }
+        }
+        s.selected = s.pending[best];
+        WriteLttb(key, s.selected);
+    }
+
+    void WriteLttb(const std::string& key, const Point& p)
+    {
+        if (m_keyed)
+        {
+            m_lttb << key << ",";
+        }
+        m_lttb << p.first << "," << p.second << "\n";
+        m_rows++;
+    }
+
+    void WriteBucket(uint32_t resolution, const std::string& key, const Bucket& b)
+    {
+        std::ofstream& out = m_files[resolution];
+        if (m_keyed)
+        {
+            out << key << ",";
+        }
+        out << b.index * m_resolutions[resolution].GetNanoSeconds() * 1e-9 << "," << b.min << "," << b.max << ","
+            << b.sum / b.samples << "," << b.last << "," << b.samples << "\n";
+        m_rows++;
+    }
+
+    std::vector<Time> m_resolutions;
+    Time m_decimation;
+    bool m_keyed;
+    std::vector<std::ofstream> m_files;
+    std::ofstream m_lttb;
+    std::map<std::string, Series> m_series;
+    uint64_t m_rows;
+};
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,116 @@
+/*
+TSO/GRO-like segmentation offload emulation.
+
+Senders build TCP super-segments of up to SuperSegmentSize bytes. Host-side
+devices get a jumbo MTU so a super-segment crosses the host link as a single
+packet (one enqueue/dequeue/transmit/receive event chain). Every other device
+keeps the Ethernet MTU, so IPv4 fragments the super-segment into MTU-sized
+packets at the first hop that leaves the host side, i.e. at the configured
+congestion points (the r1r2 bottleneck, the switch T ports, ...). The
+receiving host reassembles the fragments before TCP sees them, which gives
+GRO-style coalesced delivery and one ACK per (DelAckCount) super-segment.
+
+Queue discs at the congestion points still queue, mark and drop individual
+MTU-sized packets, but this is not equivalent to a run without offload. TCP
+itself works in super-segments:
+    - cwnd grows and shrinks in SuperSegmentSize steps, and the minimum
+      window and each CUBIC/DCTCP reduction are whole super-segments
+    - the initial window is at least one super-segment
+    - reassembly keeps the IP header of one fragment, so CE marks on the
+      other fragments are lost
+    - losing a single fragment loses the whole super-segment
+It is a speed/fidelity trade-off for bandwidth-dominated runs. Check the
+metrics of an experiment with and without it (tools/replicate.py --compare)
+before relying on it; loss-heavy and small-window runs should keep it
+disabled. RequireNoMarking() refuses it with ECN or DCTCP: a 64KB
+super-segment is ~44 wire packets, above a marking threshold of tens of
+packets on its own, and the lost CE marks would break DCTCP's alpha.
+*/
+
+#ifndef SEGMENT_OFFLOAD_H
+#define SEGMENT_OFFLOAD_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+
+#include <algorithm>
+#include <string>
+
+namespace ns3
+{
+
+class SegmentOffloadHelper
+{
+  public:
+    // IPv4 header plus a TCP header with the maximum option space
+    static const uint32_t HEADER_ROOM = 20 + 60;
+    static const uint32_t MAX_SUPER_SEGMENT = 65535 - HEADER_ROOM;
+
+    SegmentOffloadHelper(uint32_t wireMss = 1448, uint32_t superSegmentSize = 64000)
+        : m_wireMss(wireMss),
+          m_superSegmentSize(std::min(superSegmentSize, MAX_SUPER_SEGMENT))
+    {
+    }
+
+    uint32_t GetSuperSegmentSize() const
+    {
+        return m_superSegmentSize;
+    }
+
+    // Aborts when ECN marking queues or DCTCP are in use
+    static void RequireNoMarking(const std::string& tcp, bool ecnQueues)
+    {
+        NS_ABORT_MSG_IF(tcp == "ns3::TcpDctcp" || ecnQueues,
+                        "Segment offload cannot be combined with ECN marking or DCTCP: marks on the fragments of a "
+                        "super-segment are lost at reassembly");
+    }
+
+    // Switch the TCP segment size to the super-segment size. InitialCwnd is
+    // given in wire segments and rounded up to whole super-segments, so the
+    // initial window is never below one super-segment.
+    void ConfigureTcpDefaults(uint32_t initialCwndSegments) const
+    {
+        uint32_t initialBytes = initialCwndSegments * m_wireMss;
+        uint32_t initialCwnd = (initialBytes + m_superSegmentSize - 1) / m_superSegmentSize;
+        Config::SetDefault("ns3::TcpSocket::SegmentSize", UintegerValue(m_superSegmentSize));
+        Config::SetDefault("ns3::TcpSocket::InitialCwnd", UintegerValue(std::max(initialCwnd, 1u)));
+    }
+
+    // Host-side devices carry whole super-segments.
+    void EnableOnHostDevices(NetDeviceContainer devices) const
+    {
+        for (NetDeviceContainer::Iterator i = devices.Begin(); i != devices.End(); ++i)
+        {
+            (*i)->SetMtu(m_superSegmentSize + HEADER_ROOM);
+        }
+    }
+
+    void EnableOnHostDevice(Ptr<NetDevice> device) const
+    {
+        EnableOnHostDevices(NetDeviceContainer(device));
+    }
+
+    // Super-segments are split into MTU-sized packets when they are
+    // forwarded out of these devices.
+    void SetCongestionPoint(NetDeviceContainer devices, uint16_t mtu = 1500) const
+    {
+        for (NetDeviceContainer::Iterator i = devices.Begin(); i != devices.End(); ++i)
+        {
+            (*i)->SetMtu(mtu);
+        }
+    }
+
+    void SetCongestionPoint(Ptr<NetDevice> device, uint16_t mtu = 1500) const
+    {
+        SetCongestionPoint(NetDeviceContainer(device), mtu);
+    }
+
+  private:
+    uint32_t m_wireMss;
+    uint32_t m_superSegmentSize;
+};
+
+} // namespace ns3
+
+#endif
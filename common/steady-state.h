@@ -0,0 +1,316 @@
+/*
+Adaptive run length for throughput experiments.
+
+The controller samples the PacketSink byte counters of two flow groups every
+SampleInterval and folds the interval goodputs into batches. A batch spans
+BatchSize samples and at least RttsPerBatch round-trip times (SetRtt), so
+batch means are not dominated by a few congestion epochs. After every batch
+it:
+  1. drops the warm-up (slow start, initial oscillation) with the MSER rule,
+     i.e. picks the truncation point d <= n/2 that minimises the marginal
+     standard error of the remaining batch means, for each group, and takes
+     the later of the two;
+  2. estimates the ratio of the mean throughputs group0 / group1 and its 95%
+     Student-t confidence interval (delta method on the residuals
+     x_i - ratio * y_i of the batch means);
+  3. checks the lag-1 autocorrelation of those residuals. Above
+     MaxAutocorrelation the batches are merged pairwise (batch length
+     doubled) until it is not, as long as MinBatches remain;
+  4. stops the simulation once at least MinBatches uncorrelated batches
+     remain and the CI half-width is within TargetRelativeWidth of the
+     estimate.
+Batches where a group received nothing are kept. If the target is not
+reached the run ends at the caller's stop time and the result is reported
+as not converged.
+*/
+
+#ifndef STEADY_STATE_H
+#define STEADY_STATE_H
+
+#include "ns3/core-module.h"
+#include "ns3/applications-module.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace ns3
+{
+
+class SteadyStateController
+{
+  public:
+    struct Result
+    {
+        bool converged;
+        double ratio;           // steady-state throughput ratio group0 / group1
+        double ratioHalfWidth;  // 95% CI half-width of the ratio
+        double throughput[2];   // steady-state goodput per group in Mbps
+        double warmup;          // seconds discarded as warm-up
+        double stopTime;        // simulated time at which the run ended
+        uint32_t batches;       // batches used for the estimate
+        double batchLength;     // seconds per batch after merging
+        double autocorrelation; // lag-1 autocorrelation of the batch residuals
+    };
+
+    SteadyStateController()
+        : m_sampleInterval(MilliSeconds(100)),
+          m_batchSize(10),
+          m_minBatches(10),
+          m_targetRelativeWidth(0.05),
+          m_rtt(Time(0)),
+          m_rttsPerBatch(20),
+          m_maxAutocorrelation(0.2),
+          m_samplesInBatch(0),
+          m_converged(false)
+    {
+        m_lastRx[0] = m_lastRx[1] = 0;
+        m_batchBytes[0] = m_batchBytes[1] = 0;
+    }
+
+    void SetSampleInterval(Time interval)
+    {
+        m_sampleInterval = interval;
+    }
+
+    void SetBatchSize(uint32_t samples)
+    {
+        m_batchSize = samples;
+    }
+
+    void SetMinBatches(uint32_t batches)
+    {
+        m_minBatches = std::max(batches, 2u);
+    }
+
+    void SetTargetRelativeWidth(double width)
+    {
+        m_targetRelativeWidth = width;
+    }
+
+    // Round-trip time of the flows; a batch spans at least rtts of them
+    void SetRtt(Time rtt, uint32_t rtts = 20)
+    {
+        m_rtt = rtt;
+        m_rttsPerBatch = rtts;
+    }
+
+    void SetMaxAutocorrelation(double r)
+    {
+        m_maxAutocorrelation = r;
+    }
+
+    void AddSink(uint32_t group, Ptr<PacketSink> sink)
+    {
+        NS_ASSERT(group < 2);
+        m_sinks[group].push_back(sink);
+    }
+
+    // Begin sampling at start; Simulator::Stop is called as soon as the
+    // ratio has converged.
+    void Start(Time start)
+    {
+        m_start = start;
+        uint32_t rttSamples = std::ceil(m_rtt.GetSeconds() * m_rttsPerBatch / m_sampleInterval.GetSeconds());
+        m_batchSize = std::max(m_batchSize, rttSamples);
+        Simulator::Schedule(start, &SteadyStateController::Sample, this);
+    }
+
+    Result GetResult() const
+    {
+        Result r;
+        r.converged = m_converged;
+        r.stopTime = Simulator::Now().GetSeconds();
+        r.ratio = 0.0;
+        r.ratioHalfWidth = std::numeric_limits<double>::infinity();
+        r.throughput[0] = r.throughput[1] = 0.0;
+        r.warmup = 0.0;
+        r.batches = 0;
+        r.batchLength = m_batchSize * m_sampleInterval.GetSeconds();
+        r.autocorrelation = 0.0;
+
+        uint32_t n = m_throughput[0].size();
+        if (n == 0)
+        {
+            return r;
+        }
+        uint32_t d = std::max(MserTruncation(m_throughput[0]), MserTruncation(m_throughput[1]));
+        r.warmup = d * r.batchLength;
+        // Merge pairs of batches until the residuals look uncorrelated
+        for (uint32_t merge = 1; (n - d) / merge >= 2; merge *= 2)
+        {
+            uint32_t m = (n - d) / merge;
+            // The oldest batches left over by the merge are dropped
+            uint32_t first = n - m * merge;
+            std::vector<double> x(m, 0.0);
+            std::vector<double> y(m, 0.0);
+            double sumX = 0.0;
+            double sumY = 0.0;
+            for (uint32_t j = 0; j < m; j++)
+            {
+                for (uint32_t k = 0; k < merge; k++)
+                {
+                    x[j] += m_throughput[0][first + j * merge + k] / merge;
+                    y[j] += m_throughput[1][first + j * merge + k] / merge;
+                }
+                sumX += x[j];
+                sumY += y[j];
+            }
+            r.throughput[0] = sumX / m;
+            r.throughput[1] = sumY / m;
+            r.batches = m;
+            r.batchLength = merge * m_batchSize * m_sampleInterval.GetSeconds();
+            if (sumY <= 0.0)
+            {
+                r.ratio = 0.0;
+                r.ratioHalfWidth = std::numeric_limits<double>::infinity();
+                break;
+            }
+            r.ratio = sumX / sumY;
+            // Residuals of the ratio estimator, their mean is 0
+            std::vector<double> z(m);
+            double ss = 0.0;
+            for (uint32_t j = 0; j < m; j++)
+            {
+                z[j] = x[j] - r.ratio * y[j];
+                ss += z[j] * z[j];
+            }
+            double lag = 0.0;
+            for (uint32_t j = 0; j + 1 < m; j++)
+            {
+                lag += z[j] * z[j + 1];
+            }
+            r.autocorrelation = ss > 0.0 ? lag / ss : 0.0;
+            r.ratioHalfWidth = StudentT975(m - 1) * std::sqrt(ss / (m - 1) / m) / r.throughput[1];
+            if (r.autocorrelation <= m_maxAutocorrelation)
+            {
+                break;
+            }
+        }
+        return r;
+    }
+
+    // Projected stop time if the CI keeps shrinking as 1/sqrt(batches), 0 while unknown
+    Time GetEstimatedStop() const
+    {
+        if (m_converged)
+        {
+            return Simulator::Now();
+        }
+        Result r = GetResult();
+        double target = m_targetRelativeWidth * std::fabs(r.ratio);
+        if (r.batches < 2 || target <= 0.0 || !std::isfinite(r.ratioHalfWidth))
+        {
+            return Time(0);
+        }
+        double needed = std::max<double>(m_minBatches, r.batches * std::pow(r.ratioHalfWidth / target, 2));
+        return Simulator::Now() + Seconds((needed - r.batches) * r.batchLength);
+    }
+
+  private:
+    void Sample()
+    {
+        for (uint32_t g = 0; g < 2; g++)
+        {
+            uint64_t rx = 0;
+            for (Ptr<PacketSink> sink : m_sinks[g])
+            {
+                rx += sink->GetTotalRx();
+            }
+            m_batchBytes[g] += rx - m_lastRx[g];
+            m_lastRx[g] = rx;
+        }
+        // The first call only takes the baseline
+        if (Simulator::Now() > m_start && ++m_samplesInBatch == m_batchSize)
+        {
+            CloseBatch();
+        }
+        if (!m_converged)
+        {
+            Simulator::Schedule(m_sampleInterval, &SteadyStateController::Sample, this);
+        }
+    }
+
+    void CloseBatch()
+    {
+        double duration = m_batchSize * m_sampleInterval.GetSeconds();
+        m_throughput[0].push_back(m_batchBytes[0] * 8.0 / duration / 1024 / 1024);
+        m_throughput[1].push_back(m_batchBytes[1] * 8.0 / duration / 1024 / 1024);
+        m_samplesInBatch = 0;
+        m_batchBytes[0] = m_batchBytes[1] = 0;
+
+        Result r = GetResult();
+        if (r.batches >= m_minBatches && r.autocorrelation <= m_maxAutocorrelation &&
+            r.ratioHalfWidth <= m_targetRelativeWidth * std::fabs(r.ratio))
+        {
+            m_converged = true;
+            Simulator::Stop();
+        }
+    }
+
+    // Truncation point minimising sum((x_i - mean)^2) / (n - d)^2 over d <= n/2
+    static uint32_t MserTruncation(const std::vector<double>& x)
+    {
+        uint32_t n = x.size();
+        double sum = 0.0;
+        double sumSq = 0.0;
+        std::vector<double> suffix(n + 1, 0.0);
+        std::vector<double> suffixSq(n + 1, 0.0);
+        for (uint32_t i = n; i-- > 0;)
+        {
+            sum += x[i];
+            sumSq += x[i] * x[i];
+            suffix[i] = sum;
+            suffixSq[i] = sumSq;
+        }
+        uint32_t best = 0;
+        double bestValue = std::numeric_limits<double>::infinity();
+        for (uint32_t d = 0; d <= n / 2; d++)
+        {
+            double m = n - d;
+            double sse = suffixSq[d] - suffix[d] * suffix[d] / m;
+            double value = sse / (m * m);
+            if (value < bestValue)
+            {
+                bestValue = value;
+                best = d;
+            }
+        }
+        return best;
+    }
+
+    static double StudentT975(uint32_t df)
+    {
+        static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+                                       2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+                                       2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                                       2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+        if (df == 0)
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        return df <= 30 ? table[df - 1] : 1.96;
+    }
+
+    Time m_sampleInterval;
+    uint32_t m_batchSize;
+    uint32_t m_minBatches;
+    double m_targetRelativeWidth;
+    Time m_rtt;
+    uint32_t m_rttsPerBatch;
+    double m_maxAutocorrelation;
+    Time m_start;
+
+    std::vector<Ptr<PacketSink>> m_sinks[2];
+    uint64_t m_lastRx[2];
+    uint64_t m_batchBytes[2];
+    uint32_t m_samplesInBatch;
+
+    std::vector<double> m_throughput[2]; // batch means in Mbps
+    bool m_converged;
+};
+
+} // namespace ns3
+
+#endif
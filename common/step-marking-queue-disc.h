@@ -0,0 +1,117 @@
+/*
+Single-threshold ECN marking queue disc for DCTCP.
+
+DCTCP switches mark CE on every arriving packet while the instantaneous queue
+is above a threshold K. This queue disc does exactly that with O(1) work per
+packet: one size comparison on enqueue, no averaging and no random draw, as
+opposed to emulating it with RedQueueDisc and QW=1.
+
+K is a QueueSize, so it can be given in packets ("20p") or bytes ("30000B").
+It is an attribute of each queue disc instance, so ports can be configured
+individually after TrafficControlHelper::Install, e.g.
+    qdiscs.Get(0)->SetAttribute("K", QueueSizeValue(QueueSize("65p")));
+Packets that are not ECN capable are enqueued unmarked above K unless
+DropNonEct is set; the queue tail-drops at MaxSize.
+*/
+
+#ifndef STEP_MARKING_QUEUE_DISC_H
+#define STEP_MARKING_QUEUE_DISC_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/traffic-control-module.h"
+
+namespace ns3
+{
+
+class StepMarkingQueueDisc : public QueueDisc
+{
+  public:
+    static constexpr const char* LIMIT_EXCEEDED_DROP = "Queue disc limit exceeded";
+    static constexpr const char* STEP_MARK = "Queue above K";
+    static constexpr const char* NON_ECT_DROP = "Queue above K and packet not ECN capable";
+
+    static TypeId GetTypeId()
+    {
+        static TypeId tid =
+            TypeId("ns3::StepMarkingQueueDisc")
+                .SetParent<QueueDisc>()
+                .SetGroupName("TrafficControl")
+                .AddConstructor<StepMarkingQueueDisc>()
+                .AddAttribute("MaxSize",
+                              "The maximum size of the queue disc",
+                              QueueSizeValue(QueueSize("2666p")),
+                              MakeQueueSizeAccessor(&QueueDisc::SetMaxSize, &QueueDisc::GetMaxSize),
+                              MakeQueueSizeChecker())
+                .AddAttribute("K",
+                              "Marking threshold, in packets or bytes",
+                              QueueSizeValue(QueueSize("20p")),
+                              MakeQueueSizeAccessor(&StepMarkingQueueDisc::m_threshold),
+                              MakeQueueSizeChecker())
+                .AddAttribute("DropNonEct",
+                              "Drop packets that are not ECN capable when the queue is above K",
+                              BooleanValue(false),
+                              MakeBooleanAccessor(&StepMarkingQueueDisc::m_dropNonEct),
+                              MakeBooleanChecker());
+        return tid;
+    }
+
+    StepMarkingQueueDisc()
+        : QueueDisc(QueueDiscSizePolicy::SINGLE_INTERNAL_QUEUE),
+          m_dropNonEct(false)
+    {
+    }
+
+  private:
+    bool DoEnqueue(Ptr<QueueDiscItem> item) override
+    {
+        if (GetCurrentSize() + item > GetMaxSize())
+        {
+            DropBeforeEnqueue(item, LIMIT_EXCEEDED_DROP);
+            return false;
+        }
+
+        uint32_t occupancy = m_threshold.GetUnit() == QueueSizeUnit::PACKETS ? GetNPackets() : GetNBytes();
+        if (occupancy >= m_threshold.GetValue() && !Mark(item, STEP_MARK) && m_dropNonEct)
+        {
+            DropBeforeEnqueue(item, NON_ECT_DROP);
+            return false;
+        }
+
+        return GetInternalQueue(0)->Enqueue(item);
+    }
+
+    Ptr<QueueDiscItem> DoDequeue() override
+    {
+        return GetInternalQueue(0)->Dequeue();
+    }
+
+    bool CheckConfig() override
+    {
+        if (GetNQueueDiscClasses() > 0 || GetNPacketFilters() > 0)
+        {
+            NS_LOG_UNCOND("StepMarkingQueueDisc cannot have classes or packet filters");
+            return false;
+        }
+        if (GetNInternalQueues() == 0)
+        {
+            AddInternalQueue(CreateObjectWithAttributes<DropTailQueue<QueueDiscItem>>(
+                "MaxSize",
+                QueueSizeValue(GetMaxSize())));
+        }
+        return GetNInternalQueues() == 1;
+    }
+
+    void InitializeParams() override
+    {
+    }
+
+    QueueSize m_threshold;
+    bool m_dropNonEct;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(StepMarkingQueueDisc);
+
+} // namespace ns3
+
+#endif
@@ -0,0 +1,217 @@
+/*
+Per-socket TCP state tracing into one fixed-size ring buffer.
+
+Attach(socket, name) registers a flow and connects the TcpSocketBase trace
+sources for cwnd, ssthresh, RTT, bytes in flight and congestion state, plus
+the DCTCP alpha (the ECN-marked fraction estimate) when the socket's
+congestion ops are TcpDctcp. AttachApplication(app, name) does the same for
+an application that only creates its socket in StartApplication (OnOff,
+BulkSend): the socket is attached on the application's first Tx.
+
+Every update is one 16 byte record (time, flow, field, value) written into
+a ring buffer of Capacity records; when full, the oldest records are
+overwritten. With SetMinInterval(t) a field of a flow is recorded at most
+once per t, which bounds the rate of the high-frequency sources (bytes in
+flight changes on every send and ACK). Both paths are O(1) per update.
+
+Values are integers: bytes for cwnd, ssthresh and bytes in flight,
+microseconds for the RTT, alpha * 1e6 for DCTCP, and the
+TcpSocketState::TcpCongState_t value for the congestion state. Dump()
+writes the records that are still in the buffer in time order.
+*/
+
+#ifndef TCP_STATE_TRACER_H
+#define TCP_STATE_TRACER_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+class TcpStateTracer
+{
+  public:
+    enum Field
+    {
+        CWND = 0,
+        SSTHRESH,
+        RTT,
+        BYTES_IN_FLIGHT,
+        DCTCP_ALPHA,
+        CONG_STATE,
+        FIELDS
+    };
+
+    TcpStateTracer(uint32_t capacity = 1 << 20)
+        : m_records(capacity),
+          m_next(0),
+          m_count(0),
+          m_minInterval(Time(0))
+    {
+    }
+
+    void SetMinInterval(Time interval)
+    {
+        m_minInterval = interval;
+    }
+
+    uint32_t Attach(Ptr<Socket> socket, std::string name)
+    {
+        uint32_t flow = AddFlow(name);
+        Connect(socket, flow);
+        return flow;
+    }
+
+    // For applications that create their socket on start and expose it with GetSocket()
+    template <class App>
+    uint32_t AttachApplication(Ptr<App> app, std::string name)
+    {
+        uint32_t flow = AddFlow(name);
+        app->TraceConnectWithoutContext(
+            "Tx",
+            MakeBoundCallback(&TcpStateTracer::FirstTx<App>, this, flow, PeekPointer(app)));
+        return flow;
+    }
+
+    // Records lost to overwriting are not reported
+    uint64_t GetOverwritten() const
+    {
+        return m_count > m_records.size() ? m_count - m_records.size() : 0;
+    }
+
+    void Dump(std::ostream& out) const
+    {
+        out << "Time(s),Flow,Field,Value\n";
+        static const char* names[FIELDS] = {"cwnd", "ssthresh", "rtt_us", "inflight", "alpha_e6", "state"};
+        uint64_t size = std::min<uint64_t>(m_count, m_records.size());
+        uint64_t start = m_count > m_records.size() ? m_next : 0;
+        for (uint64_t i = 0; i < size; i++)
+        {
+            const Record& r = m_records[(start + i) % m_records.size()];
+            out << r.time * 1e-9 << "," << m_flows[r.flow].name << "," << names[r.field] << "," << r.value
+                << "\n";
+        }
+    }
+
+  private:
+    struct Record
+    {
+        int64_t time; // ns
+        uint16_t flow;
+        uint8_t field;
+        uint8_t reserved;
+        uint32_t value;
+    };
+
+    struct Flow
+    {
+        std::string name;
+        bool attached;
+        int64_t last[FIELDS];
+    };
+
+    uint32_t AddFlow(std::string name)
+    {
+        NS_ABORT_MSG_IF(m_flows.size() > UINT16_MAX, "Too many flows for TcpStateTracer");
+        Flow flow;
+        flow.name = name;
+        flow.attached = false;
+        for (uint32_t f = 0; f < FIELDS; f++)
+        {
+            flow.last[f] = INT64_MIN;
+        }
+        m_flows.push_back(flow);
+        return m_flows.size() - 1;
+    }
+
+    void Connect(Ptr<Socket> socket, uint32_t flow)
+    {
+        m_flows[flow].attached = true;
+        socket->TraceConnectWithoutContext("CongestionWindow", MakeBoundCallback(&TcpStateTracer::OnU32, this, flow, CWND));
+        socket->TraceConnectWithoutContext("SlowStartThreshold",
+                                           MakeBoundCallback(&TcpStateTracer::OnU32, this, flow, SSTHRESH));
+        socket->TraceConnectWithoutContext("BytesInFlight",
+                                           MakeBoundCallback(&TcpStateTracer::OnU32, this, flow, BYTES_IN_FLIGHT));
+        socket->TraceConnectWithoutContext("RTT", MakeBoundCallback(&TcpStateTracer::OnRtt, this, flow));
+        socket->TraceConnectWithoutContext("CongState", MakeBoundCallback(&TcpStateTracer::OnState, this, flow));
+
+        PointerValue ops;
+        if (socket->GetAttributeFailSafe("CongestionOps", ops))
+        {
+            Ptr<TcpDctcp> dctcp = DynamicCast<TcpDctcp>(ops.Get<TcpCongestionOps>());
+            if (dctcp)
+            {
+                dctcp->TraceConnectWithoutContext("CongestionEstimate",
+                                                  MakeBoundCallback(&TcpStateTracer::OnAlpha, this, flow));
+            }
+        }
+    }
+
+    template <class App>
+    static void FirstTx(TcpStateTracer* tracer, uint32_t flow, App* app, Ptr<const Packet> packet)
+    {
+        if (!tracer->m_flows[flow].attached && app->GetSocket())
+        {
+            tracer->Connect(app->GetSocket(), flow);
+        }
+    }
+
+    void Store(uint32_t flow, uint8_t field, uint32_t value)
+    {
+        int64_t now = Simulator::Now().GetNanoSeconds();
+        int64_t& last = m_flows[flow].last[field];
+        if (m_minInterval.IsStrictlyPositive() && last != INT64_MIN && now - last < m_minInterval.GetNanoSeconds())
+        {
+            return;
+        }
+        last = now;
+        Record& r = m_records[m_next];
+        r.time = now;
+        r.flow = flow;
+        r.field = field;
+        r.value = value;
+        m_next = m_next + 1 == m_records.size() ? 0 : m_next + 1;
+        m_count++;
+    }
+
+    static void OnU32(TcpStateTracer* tracer, uint32_t flow, uint8_t field, uint32_t oldValue, uint32_t newValue)
+    {
+        tracer->Store(flow, field, newValue);
+    }
+
+    static void OnRtt(TcpStateTracer* tracer, uint32_t flow, Time oldValue, Time newValue)
+    {
+        tracer->Store(flow, RTT, newValue.GetMicroSeconds());
+    }
+
+    static void OnState(TcpStateTracer* tracer,
+                        uint32_t flow,
+                        TcpSocketState::TcpCongState_t oldValue,
+                        TcpSocketState::TcpCongState_t newValue)
+    {
+        tracer->Store(flow, CONG_STATE, newValue);
+    }
+
+    static void OnAlpha(TcpStateTracer* tracer, uint32_t flow, uint32_t bytesAcked, uint32_t bytesMarked, double alpha)
+    {
+        tracer->Store(flow, DCTCP_ALPHA, alpha * 1e6);
+    }
+
+    std::vector<Record> m_records;
+    uint64_t m_next;
+    uint64_t m_count;
+    Time m_minInterval;
+    std::vector<Flow> m_flows;
+};
+
+} // namespace ns3
+
+#endif
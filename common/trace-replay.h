@@ -0,0 +1,494 @@
+/*
+Streaming replay of recorded flow logs over TCP.
+
+The log is a CSV file with one flow per line, sorted by start time:
+    start,src,dst,bytes,job[,iteration[,fct]]
+start and fct are in seconds, src and dst are host names, job is any
+label and iteration an integer (0 when absent). fct is the recorded flow
+completion time, if known. Empty lines, lines starting with '#' and a
+header line are skipped. Start times are taken relative to the first flow,
+so epoch timestamps can be used as they are.
+
+The file is read one line ahead: the next flow is parsed and its start is
+scheduled, and reading continues when it fires. Only the flows in flight
+are kept in memory, so logs of any length can be replayed. Host names are
+mapped to nodes with MapHost(); unmapped names are spread round robin over
+the nodes given to SetHosts(), in order of first appearance. Each flow is
+one TCP connection from its source node to a listener the replay opens on
+the destination node; flows whose ends map to the same node are skipped.
+Flows are told apart by the source address and port, so hosts must have a
+single interface (interface 1).
+
+When a flow's last byte is received, one row goes to the flow output: the
+FCT, the recorded FCT and their ratio (slowdown). The flows with the same
+job and iteration form one iteration, which lasts from its first start to
+its last completion. The iteration is written to the job output once all
+its flows have completed and a later iteration of the same job has been
+read, or at Finish(). The row holds the simulated and recorded durations
+and their ratio (stretch). The recorded duration is only known when every
+flow of the iteration has a recorded FCT.
+*/
+
+#ifndef TRACE_REPLAY_H
+#define TRACE_REPLAY_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+
+class TraceReplay
+{
+  public:
+    TraceReplay()
+        : m_port(5000),
+          m_offset(Time(0)),
+          m_flowOut(nullptr),
+          m_jobOut(nullptr),
+          m_nextHost(0),
+          m_firstStart(-1),
+          m_lastStart(-1),
+          m_line(0),
+          m_started(0),
+          m_completed(0),
+          m_skipped(0)
+    {
+    }
+
+    void MapHost(std::string name, Ptr<Node> node)
+    {
+        m_hostMap[name] = node;
+    }
+
+    // Nodes for the host names that are not mapped explicitly
+    void SetHosts(NodeContainer nodes)
+    {
+        m_pool = nodes;
+    }
+
+    void SetPort(uint16_t port)
+    {
+        m_port = port;
+    }
+
+    // Simulation time of the first flow in the log
+    void SetStartTime(Time offset)
+    {
+        m_offset = offset;
+    }
+
+    void SetFlowOutput(std::ostream* out)
+    {
+        m_flowOut = out;
+    }
+
+    void SetJobOutput(std::ostream* out)
+    {
+        m_jobOut = out;
+    }
+
+    static void WriteFlowHeader(std::ostream& out)
+    {
+        out << "Job,Iteration,Src,Dst,Bytes,Start(s),FCT(ms),RecordedFCT(ms),Slowdown\n";
+    }
+
+    static void WriteJobHeader(std::ostream& out)
+    {
+        out << "Job,Iteration,Flows,Start(s),Duration(ms),RecordedDuration(ms),Stretch,Complete\n";
+    }
+
+    void Start(std::string path)
+    {
+        m_file.open(path);
+        NS_ABORT_MSG_IF(!m_file.is_open(), "Cannot open flow log " << path);
+        ReadNext();
+    }
+
+    // Writes the iterations still open; flows that have not completed are counted as incomplete
+    void Finish()
+    {
+        for (std::map<std::string, Iteration>::iterator it = m_iterations.begin(); it != m_iterations.end(); it++)
+        {
+            WriteIteration(it->first, it->second);
+        }
+        m_iterations.clear();
+        m_file.close();
+    }
+
+    uint64_t GetStarted() const
+    {
+        return m_started;
+    }
+
+    uint64_t GetCompleted() const
+    {
+        return m_completed;
+    }
+
+    uint64_t GetSkipped() const
+    {
+        return m_skipped;
+    }
+
+  private:
+    struct Row
+    {
+        double start;
+        std::string src;
+        std::string dst;
+        uint64_t bytes;
+        std::string job;
+        uint32_t iteration;
+        double fct; // < 0 when not recorded
+    };
+
+    struct Flow
+    {
+        std::string key; // job and iteration
+        std::string src;
+        std::string dst;
+        uint64_t bytes;
+        uint64_t sent;
+        uint64_t received;
+        Time start;
+        double recordedStart;
+        double fct;
+        Ptr<Socket> socket;
+    };
+
+    struct Iteration
+    {
+        std::string job;
+        uint32_t iteration;
+        uint32_t flows;
+        uint32_t pending;
+        Time start;
+        Time end;
+        double recordedStart;
+        double recordedEnd;
+        bool recordedKnown;
+    };
+
+    bool Parse(const std::string& line, Row& row)
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            return false;
+        }
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ','))
+        {
+            fields.push_back(field);
+        }
+        char* end = nullptr;
+        row.start = fields.empty() ? 0 : std::strtod(fields[0].c_str(), &end);
+        if (fields.size() < 5 || end == fields[0].c_str())
+        {
+            // Header line
+            NS_ABORT_MSG_IF(m_firstStart >= 0, "Malformed flow log line " << m_line << ": " << line);
+            return false;
+        }
+        row.src = fields[1];
+        row.dst = fields[2];
+        row.bytes = std::strtoull(fields[3].c_str(), nullptr, 10);
+        row.job = fields[4];
+        row.iteration = fields.size() > 5 && !fields[5].empty() ? std::strtoul(fields[5].c_str(), nullptr, 10) : 0;
+        row.fct = fields.size() > 6 && !fields[6].empty() ? std::strtod(fields[6].c_str(), nullptr) : -1;
+        return true;
+    }
+
+    void ReadNext()
+    {
+        std::string line;
+        while (std::getline(m_file, line))
+        {
+            m_line++;
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!Parse(line, m_next))
+            {
+                continue;
+            }
+            NS_ABORT_MSG_IF(m_next.start < m_lastStart, "Flow log is not sorted by start time at line " << m_line);
+            m_lastStart = m_next.start;
+            if (m_firstStart < 0)
+            {
+                m_firstStart = m_next.start;
+            }
+            Time at = m_offset + Seconds(m_next.start - m_firstStart);
+            Simulator::Schedule(std::max(at - Simulator::Now(), Time(0)), &TraceReplay::StartNext, this);
+            return;
+        }
+    }
+
+    void StartNext()
+    {
+        Row row = m_next;
+        ReadNext();
+        StartFlow(row);
+    }
+
+    Ptr<Node> Resolve(const std::string& name)
+    {
+        std::map<std::string, Ptr<Node>>::iterator it = m_hostMap.find(name);
+        if (it != m_hostMap.end())
+        {
+            return it->second;
+        }
+        NS_ABORT_MSG_IF(m_pool.GetN() == 0, "Host " << name << " is not mapped and no host pool is set");
+        Ptr<Node> node = m_pool.Get(m_nextHost++ % m_pool.GetN());
+        m_hostMap[name] = node;
+        return node;
+    }
+
+    void StartFlow(const Row& row)
+    {
+        Ptr<Node> src = Resolve(row.src);
+        Ptr<Node> dst = Resolve(row.dst);
+        if (src == dst || row.bytes == 0)
+        {
+            m_skipped++;
+            return;
+        }
+        Listen(dst);
+
+        std::string key = row.job + "#" + std::to_string(row.iteration);
+        std::map<std::string, uint32_t>::iterator latest = m_latestIteration.find(row.job);
+        if (latest == m_latestIteration.end() || row.iteration > latest->second)
+        {
+            uint32_t previous = latest == m_latestIteration.end() ? row.iteration : latest->second;
+            m_latestIteration[row.job] = row.iteration;
+            if (previous != row.iteration)
+            {
+                CloseIfDone(row.job + "#" + std::to_string(previous));
+            }
+        }
+        std::map<std::string, Iteration>::iterator it = m_iterations.find(key);
+        if (it == m_iterations.end())
+        {
+            Iteration iteration;
+            iteration.job = row.job;
+            iteration.iteration = row.iteration;
+            iteration.flows = 0;
+            iteration.pending = 0;
+            iteration.start = Simulator::Now();
+            iteration.end = Simulator::Now();
+            iteration.recordedStart = row.start;
+            iteration.recordedEnd = row.start;
+            iteration.recordedKnown = true;
+            it = m_iterations.emplace(key, iteration).first;
+        }
+        it->second.flows++;
+        it->second.pending++;
+        it->second.recordedKnown = it->second.recordedKnown && row.fct >= 0;
+        it->second.recordedEnd = std::max(it->second.recordedEnd, row.start + std::max(row.fct, 0.0));
+
+        Flow flow;
+        flow.key = key;
+        flow.src = row.src;
+        flow.dst = row.dst;
+        flow.bytes = row.bytes;
+        flow.sent = 0;
+        flow.received = 0;
+        flow.start = Simulator::Now();
+        flow.recordedStart = row.start;
+        flow.fct = row.fct;
+        flow.socket = Socket::CreateSocket(src, TcpSocketFactory::GetTypeId());
+        flow.socket->Bind();
+        Address local;
+        flow.socket->GetSockName(local);
+        uint64_t endpoint = Endpoint(src->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(),
+                                     InetSocketAddress::ConvertFrom(local).GetPort());
+        m_flows[endpoint] = flow;
+        m_started++;
+
+        flow.socket->SetConnectCallback(MakeBoundCallback(&TraceReplay::Connected, this, endpoint),
+                                        MakeNullCallback<void, Ptr<Socket>>());
+        flow.socket->SetSendCallback(MakeBoundCallback(&TraceReplay::Fill, this, endpoint));
+        flow.socket->Connect(InetSocketAddress(dst->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(), m_port));
+    }
+
+    static uint64_t Endpoint(Ipv4Address address, uint16_t port)
+    {
+        return (uint64_t)address.Get() << 16 | port;
+    }
+
+    static void Connected(TraceReplay* replay, uint64_t endpoint, Ptr<Socket> socket)
+    {
+        Fill(replay, endpoint, socket, socket->GetTxAvailable());
+    }
+
+    // Queue as much of the flow as the send buffer takes, close after the last byte
+    static void Fill(TraceReplay* replay, uint64_t endpoint, Ptr<Socket> socket, uint32_t available)
+    {
+        std::unordered_map<uint64_t, Flow>::iterator it = replay->m_flows.find(endpoint);
+        if (it == replay->m_flows.end() || !it->second.socket)
+        {
+            return;
+        }
+        Flow& flow = it->second;
+        while (flow.sent < flow.bytes && socket->GetTxAvailable() > 0)
+        {
+            uint32_t size = std::min<uint64_t>(flow.bytes - flow.sent, std::min<uint32_t>(socket->GetTxAvailable(), 65536));
+            int sent = socket->Send(Create<Packet>(size));
+            if (sent <= 0)
+            {
+                return;
+            }
+            flow.sent += sent;
+        }
+        if (flow.sent == flow.bytes)
+        {
+            socket->Close();
+            flow.socket = nullptr;
+        }
+    }
+
+    void Listen(Ptr<Node> node)
+    {
+        if (m_listeners.count(node->GetId()))
+        {
+            return;
+        }
+        Ptr<Socket> listener = Socket::CreateSocket(node, TcpSocketFactory::GetTypeId());
+        listener->Bind(InetSocketAddress(Ipv4Address::GetAny(), m_port));
+        listener->Listen();
+        listener->SetAcceptCallback(MakeNullCallback<bool, Ptr<Socket>, const Address&>(),
+                                    MakeCallback(&TraceReplay::Accepted, this));
+        m_listeners[node->GetId()] = listener;
+    }
+
+    void Accepted(Ptr<Socket> socket, const Address& from)
+    {
+        socket->SetRecvCallback(MakeCallback(&TraceReplay::Received, this));
+    }
+
+    void Received(Ptr<Socket> socket)
+    {
+        Address from;
+        Ptr<Packet> packet;
+        while ((packet = socket->RecvFrom(from)) && packet->GetSize() > 0)
+        {
+            InetSocketAddress peer = InetSocketAddress::ConvertFrom(from);
+            uint64_t endpoint = Endpoint(peer.GetIpv4(), peer.GetPort());
+            std::unordered_map<uint64_t, Flow>::iterator it = m_flows.find(endpoint);
+            if (it == m_flows.end())
+            {
+                continue;
+            }
+            it->second.received += packet->GetSize();
+            if (it->second.received >= it->second.bytes)
+            {
+                Complete(it->second);
+                m_flows.erase(it);
+                socket->Close();
+                return;
+            }
+        }
+    }
+
+    void Complete(const Flow& flow)
+    {
+        m_completed++;
+        Time fct = Simulator::Now() - flow.start;
+        std::map<std::string, Iteration>::iterator it = m_iterations.find(flow.key);
+        if (m_flowOut)
+        {
+            *m_flowOut << (it != m_iterations.end() ? it->second.job : flow.key) << ","
+                       << (it != m_iterations.end() ? it->second.iteration : 0) << "," << flow.src << ","
+                       << flow.dst << "," << flow.bytes << "," << flow.start.GetSeconds() << ","
+                       << fct.GetSeconds() * 1e3 << ",";
+            if (flow.fct > 0)
+            {
+                *m_flowOut << flow.fct * 1e3 << "," << fct.GetSeconds() / flow.fct;
+            }
+            else
+            {
+                *m_flowOut << ",";
+            }
+            *m_flowOut << "\n";
+        }
+        if (it == m_iterations.end())
+        {
+            return;
+        }
+        it->second.pending--;
+        it->second.end = std::max(it->second.end, Simulator::Now());
+        std::map<std::string, uint32_t>::iterator latest = m_latestIteration.find(it->second.job);
+        if (latest != m_latestIteration.end() && latest->second != it->second.iteration)
+        {
+            CloseIfDone(flow.key);
+        }
+    }
+
+    void CloseIfDone(const std::string& key)
+    {
+        std::map<std::string, Iteration>::iterator it = m_iterations.find(key);
+        if (it != m_iterations.end() && it->second.pending == 0)
+        {
+            WriteIteration(key, it->second);
+            m_iterations.erase(it);
+        }
+    }
+
+    void WriteIteration(const std::string& key, const Iteration& iteration)
+    {
+        if (!m_jobOut)
+        {
+            return;
+        }
+        double duration = (iteration.end - iteration.start).GetSeconds();
+        double recorded = iteration.recordedEnd - iteration.recordedStart;
+        *m_jobOut << iteration.job << "," << iteration.iteration << "," << iteration.flows << ","
+                  << iteration.start.GetSeconds() << "," << duration * 1e3 << ",";
+        if (iteration.recordedKnown && recorded > 0)
+        {
+            *m_jobOut << recorded * 1e3 << "," << duration / recorded;
+        }
+        else
+        {
+            *m_jobOut << ",";
+        }
+        *m_jobOut << "," << (iteration.pending == 0) << "\n";
+    }
+
+    uint16_t m_port;
+    Time m_offset;
+    std::ostream* m_flowOut;
+    std::ostream* m_jobOut;
+    std::map<std::string, Ptr<Node>> m_hostMap;
+    NodeContainer m_pool;
+    uint32_t m_nextHost;
+    std::ifstream m_file;
+    Row m_next;
+    double m_firstStart;
+    double m_lastStart;
+    uint64_t m_line;
+    std::map<uint32_t, Ptr<Socket>> m_listeners;
+    std::unordered_map<uint64_t, Flow> m_flows;
+    std::map<std::string, Iteration> m_iterations;
+    std::map<std::string, uint32_t> m_latestIteration;
+    uint64_t m_started;
+    uint64_t m_completed;
+    uint64_t m_skipped;
+};
+
+} // namespace ns3
+
+#endif
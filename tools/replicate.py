@@ -0,0 +1,219 @@
+# Run an experiment over several independent RngRun streams and aggregate its results.
+#
+# Every replication runs in its own directory (so the fixed output file names of the
+# experiments do not clash) with NS_GLOBAL_VALUE="RngRun=<k>", which ns-3 reads at
+# start-up, so it works for every program whether or not it parses the command line.
+# Replications are run in waves of --jobs parallel processes. After each wave the
+# per-metric mean, standard deviation and 95% confidence interval are recomputed and
+# no further replications are started once every metric is within --precision.
+#
+# With --compare, a second command runs with the same RngRun in every replication
+# and --comparison gets both means side by side with the paired difference and its
+# 95% CI, e.g. to check what an emulation shortcut such as --segmentOffload changes.
+#
+# A relative program path at the start of --program/--compare is resolved against the
+# directory replicate.py is started from. A replication that fails or writes no usable
+# --output file is reported and left out.
+#
+# Example:
+#   python3 replicate.py --program build/scratch/cubic-exp2/ns3.43-Experiment2-default \
+#       --output tcp_fairness.csv --key TCP_Variant,RTT --metrics Throughput_Ratio
+#   python3 replicate.py --program "$EXP1 --segmentOffload=0" --compare "$EXP1 --segmentOffload=1" \
+#       --output goodput.csv
+
+import argparse
+import csv
+import math
+import os
+import shlex
+import statistics
+import subprocess
+from concurrent.futures import ThreadPoolExecutor
+
+# Two-sided 95% Student-t quantiles for 1..30 degrees of freedom
+T975 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+
+def t975(df):
+    if df <= 0:
+        return math.inf
+    return T975[df - 1] if df <= len(T975) else 1.96
+
+
+def run_replication(args, run):
+    run_dir = os.path.join(args.workdir, "run-%d" % run)
+    results = run_program(args, args.program, run_dir, run)
+    if results is None or not args.compare:
+        return None if results is None else (results, None)
+    compared = run_program(args, args.compare, os.path.join(run_dir, "compare"), run)
+    return None if compared is None else (results, compared)
+
+
+def resolve_program(command):
+    # The command runs in the replication directory, so a relative program path is made
+    # absolute against the directory replicate.py was started from
+    parts = command.split(None, 1)
+    if parts and os.sep in parts[0] and not os.path.isabs(parts[0]) and os.path.exists(parts[0]):
+        parts[0] = shlex.quote(os.path.abspath(parts[0]))
+    return " ".join(parts)
+
+
+def run_program(args, program, run_dir, run):
+    os.makedirs(run_dir, exist_ok=True)
+    env = dict(os.environ)
+    globals_ = [g for g in env.get("NS_GLOBAL_VALUE", "").split(";") if g and not g.startswith("RngRun=")]
+    globals_.append("RngRun=%d" % run)
+    env["NS_GLOBAL_VALUE"] = ";".join(globals_)
+    with open(os.path.join(run_dir, "stdout.log"), "w") as out, open(os.path.join(run_dir, "stderr.log"), "w") as err:
+        result = subprocess.run(program, shell=True, cwd=run_dir, env=env, stdout=out, stderr=err)
+    if result.returncode != 0:
+        print("Replication %d failed with exit code %d, see %s" % (run, result.returncode, run_dir))
+        return None
+    path = os.path.join(run_dir, args.output)
+    try:
+        return read_results(path, args.key)
+    except (OSError, csv.Error, KeyError) as e:
+        print("Replication %d produced no usable %s (%s), see %s" % (run, args.output, e, run_dir))
+        return None
+
+
+def read_results(path, key):
+    # Returns {key tuple: {metric: value}} for the numeric columns of the output file
+    rows = {}
+    with open(path) as f:
+        reader = csv.DictReader(f, delimiter=',')
+        for index, row in enumerate(reader):
+            row_key = tuple(row[k] for k in key) if key else (str(index),)
+            values = {}
+            for column, value in row.items():
+                if not column or column in key:
+                    continue
+                try:
+                    number = float(value)
+                except (TypeError, ValueError):
+                    continue
+                if math.isfinite(number):
+                    values[column.strip()] = number
+            rows[row_key] = values
+    return rows
+
+
+def aggregate(results):
+    # {key: {metric: (n, mean, stddev, ci95)}}
+    samples = {}
+    for run in results:
+        for row_key, values in run.items():
+            for metric, value in values.items():
+                samples.setdefault(row_key, {}).setdefault(metric, []).append(value)
+    summary = {}
+    for row_key, metrics in samples.items():
+        for metric, values in metrics.items():
+            n = len(values)
+            mean = statistics.mean(values)
+            stddev = statistics.stdev(values) if n > 1 else math.inf
+            ci = t975(n - 1) * stddev / math.sqrt(n) if n > 1 else math.inf
+            summary.setdefault(row_key, {})[metric] = (n, mean, stddev, ci)
+    return summary
+
+
+def precise_enough(summary, metrics, precision, absolute):
+    for row_key, stats in summary.items():
+        for metric, (n, mean, stddev, ci) in stats.items():
+            if metrics and metric not in metrics:
+                continue
+            if ci > max(precision * abs(mean), absolute):
+                return False
+    return True
+
+
+def write_summary(path, summary, key):
+    metrics = sorted({m for stats in summary.values() for m in stats})
+    with open(path, "w", newline='') as f:
+        writer = csv.writer(f)
+        header = list(key) if key else ["Row"]
+        for metric in metrics:
+            header += [metric + "_mean", metric + "_std", metric + "_ci95", metric + "_n"]
+        writer.writerow(header)
+        for row_key in sorted(summary):
+            line = list(row_key)
+            for metric in metrics:
+                n, mean, stddev, ci = summary[row_key].get(metric, (0, math.nan, math.nan, math.nan))
+                line += [mean, stddev, ci, n]
+            writer.writerow(line)
+
+
+def write_comparison(path, results, key):
+    # Per metric: mean of --program, mean of --compare, paired difference and its CI
+    diffs = {}
+    for primary, compared in results:
+        for row_key, values in primary.items():
+            for metric, value in values.items():
+                other = compared.get(row_key, {}).get(metric)
+                if other is not None:
+                    diffs.setdefault((row_key, metric), []).append((value, other))
+    with open(path, "w", newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow((list(key) if key else ["Row"]) +
+                        ["Metric", "Program_mean", "Compare_mean", "Diff_mean", "Diff_ci95", "n"])
+        for row_key, metric in sorted(diffs):
+            pairs = diffs[(row_key, metric)]
+            n = len(pairs)
+            d = [b - a for a, b in pairs]
+            ci = t975(n - 1) * statistics.stdev(d) / math.sqrt(n) if n > 1 else math.inf
+            writer.writerow(list(row_key) + [metric, statistics.mean(a for a, _ in pairs),
+                                             statistics.mean(b for _, b in pairs), statistics.mean(d), ci, n])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Multi-seed replication driver")
+    parser.add_argument("--program", required=True, help="command that runs one replication")
+    parser.add_argument("--output", required=True, help="CSV file the program writes in its working directory")
+    parser.add_argument("--key", default="", help="comma separated columns identifying a row, default: row index")
+    parser.add_argument("--metrics", default="", help="comma separated columns that must reach the precision, default: all")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count(), help="replications run in parallel")
+    parser.add_argument("--min-reps", type=int, default=3)
+    parser.add_argument("--max-reps", type=int, default=30)
+    parser.add_argument("--precision", type=float, default=0.05, help="target CI half-width relative to the mean")
+    parser.add_argument("--absolute", type=float, default=0.0, help="CI half-width always accepted, for metrics near 0")
+    parser.add_argument("--first-run", type=int, default=1, help="RngRun of the first replication")
+    parser.add_argument("--workdir", default="replications")
+    parser.add_argument("--summary", default="summary.csv")
+    parser.add_argument("--compare", default="", help="second command run with the same RngRun streams")
+    parser.add_argument("--comparison", default="comparison.csv", help="side-by-side output of --compare")
+    args = parser.parse_args()
+    args.key = [k for k in args.key.split(",") if k]
+    args.program = resolve_program(args.program)
+    if args.compare:
+        args.compare = resolve_program(args.compare)
+    metrics = [m for m in args.metrics.split(",") if m]
+
+    results = []
+    next_run = args.first_run
+    summary = {}
+    with ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        while len(results) < args.max_reps:
+            wave = max(args.jobs, args.min_reps - len(results))
+            wave = min(wave, args.max_reps - len(results))
+            runs = list(range(next_run, next_run + wave))
+            next_run += wave
+            completed = [r for r in pool.map(lambda run: run_replication(args, run), runs) if r is not None]
+            if not completed:
+                print("No replication of the last wave succeeded, stopping")
+                break
+            results += completed
+            summary = aggregate([primary for primary, _ in results])
+            print("Replications: %d" % len(results))
+            if len(results) >= args.min_reps and precise_enough(summary, metrics, args.precision, args.absolute):
+                break
+
+    write_summary(args.summary, summary, args.key)
+    print("Summary written to %s" % args.summary)
+    if args.compare:
+        write_comparison(args.comparison, results, args.key)
+        print("Comparison written to %s" % args.comparison)
+
+
+if __name__ == "__main__":
+    main()